@@ -0,0 +1,186 @@
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "config.hpp"
+#include "pg.hpp"
+#include "synthetic.hpp"
+
+namespace fs = std::filesystem;
+
+// text as a JSON string literal, quotes included.
+std::string jsonString(const std::string& text) {
+    std::string out = "\"";
+    for(unsigned char c : text) {
+        if(c == '"' || c == '\\') {
+            out += '\\';
+            out += static_cast<char>(c);
+        } else if(c < 0x20) {
+            char escaped[8];
+            std::snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+            out += escaped;
+        } else {
+            out += static_cast<char>(c);
+        }
+    }
+    return out + '"';
+}
+
+// Runs args[0] with args, stdout discarded, without a shell in between, so
+// paths and labels are passed through as they are. Returns the wait status.
+int runDiscardingOutput(const std::vector<std::string>& args) {
+    std::vector<char*> argv;
+    for(const auto& arg : args) argv.push_back(const_cast<char*>(arg.c_str()));
+    argv.push_back(nullptr);
+    pid_t pid = fork();
+    if(pid < 0) throw std::runtime_error("fork failed");
+    if(pid == 0) {
+        int null_fd = open("/dev/null", O_WRONLY);
+        if(null_fd >= 0) dup2(null_fd, STDOUT_FILENO);
+        execvp(argv[0], argv.data());
+        _exit(127);
+    }
+    int status = 0;
+    while(waitpid(pid, &status, 0) < 0) {
+        if(errno != EINTR) throw std::runtime_error("waitpid failed");
+    }
+    return status;
+}
+
+// Runs exscribo end to end against a synthetic data set and appends one JSON
+// line per run to the results file: wall time, rows and bytes landed in the
+// destination, throughput, and the per-phase metrics exscribo wrote.
+int main(int argc, char** argv)
+{
+    SyntheticParams params;
+    std::string exscribo = "bin/Release/exscribo";
+    std::string results_file = "bench/results.jsonl";
+    std::string label;
+    size_t roots = 10, repeat = 3, jobs = 4;
+    bool generate = true;
+    for(int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if(parseSyntheticArg(argc, argv, i, params)) {
+            continue;
+        } else if(arg == "--no-generate") {
+            generate = false;
+        } else if(arg == "--exscribo" && i + 1 < argc) {
+            exscribo = argv[++i];
+        } else if(arg == "--out" && i + 1 < argc) {
+            results_file = argv[++i];
+        } else if(arg == "--label" && i + 1 < argc) {
+            label = argv[++i];
+        } else if(arg == "--roots" && i + 1 < argc) {
+            roots = std::strtoull(argv[++i], nullptr, 10);
+        } else if(arg == "--repeat" && i + 1 < argc) {
+            repeat = std::strtoull(argv[++i], nullptr, 10);
+        } else if(arg == "--jobs" && i + 1 < argc) {
+            jobs = std::strtoull(argv[++i], nullptr, 10);
+        } else {
+            std::cerr << "Usage: exscribo-bench [options]\n" << SYNTHETIC_USAGE
+                      << "  --no-generate        reuse the data set already in the source\n"
+                      << "  --exscribo <path>    binary to run (default bin/Release/exscribo)\n"
+                      << "  --roots <n>          root ids 1..n copied per run (default 10)\n"
+                      << "  --repeat <n>         runs to record (default 3)\n"
+                      << "  --jobs <n>           passed through to exscribo (default 4)\n"
+                      << "  --label <text>       stored with every result, e.g. a commit id\n"
+                      << "  --out <file>         results file (default bench/results.jsonl)\n";
+            return -1;
+        }
+    }
+
+    DBConfig config;
+    parseFileIntoConfig(".env", config);
+    try {
+        if(generate) {
+            PgConnection source{config.source};
+            std::cout << "Generating source data set\n";
+            createSyntheticSchema(source, params);
+            fillSyntheticData(source, params);
+        }
+
+        fs::path metrics_dir = fs::path(results_file).parent_path() / "metrics";
+        fs::create_directories(metrics_dir);
+
+        // Row and byte totals are read back from the destination rather than
+        // trusted from the tool under test.
+        std::string count_sql = "SELECT 0", size_sql = "SELECT 0";
+        for(const auto& table : syntheticTables(params)) {
+            count_sql += " + (SELECT count(*) FROM " + quoteIdentifier(table.name) + ")";
+            size_sql += " + pg_table_size(" + quoteLiteral(quoteIdentifier(table.name)) + ")";
+        }
+
+        for(size_t run = 0; run < repeat; ++run) {
+            // A fresh, empty destination schema for every run.
+            {
+                PgConnection destination{config.destination};
+                createSyntheticSchema(destination, params);
+            }
+            fs::path metrics_file = metrics_dir / ("run_" + std::to_string(std::time(nullptr)) + "_" + std::to_string(run) + ".json");
+            std::vector<std::string> run_args = {exscribo, "--jobs", std::to_string(jobs), "--metrics", metrics_file.string(), SYNTHETIC_ROOT};
+            for(size_t id = 1; id <= roots; ++id) {
+                run_args.push_back(std::to_string(id));
+            }
+
+            auto before = std::chrono::steady_clock::now();
+            int status = runDiscardingOutput(run_args);
+            std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - before;
+            if(status != 0) {
+                std::cerr << "exscribo failed with status " << status << ":";
+                for(const auto& arg : run_args) std::cerr << ' ' << arg;
+                std::cerr << '\n';
+                return 1;
+            }
+
+            PgConnection destination{config.destination};
+            destination.execute("ANALYZE;");
+            unsigned long long rows = std::stoull(destination.query(count_sql + ";").at(0).at(0));
+            unsigned long long bytes = std::stoull(destination.query(size_sql + ";").at(0).at(0));
+
+            std::string metrics;
+            {
+                std::ifstream ifs(metrics_file);
+                std::stringstream contents;
+                contents << ifs.rdbuf();
+                metrics = contents.str();
+            }
+            // One line per run: the metrics file is compact JSON apart from its newlines.
+            for(char& c : metrics) {
+                if(c == '\n') c = ' ';
+            }
+
+            std::ostringstream line;
+            line << std::fixed
+                 << "{\"time\": " << std::time(nullptr) << ", \"label\": " << jsonString(label)
+                 << ", \"depth\": " << params.depth << ", \"fanout\": " << params.fanout
+                 << ", \"supporters\": " << params.supporters << ", \"rows_per_table\": " << params.rows
+                 << ", \"jsonb_bytes\": " << params.jsonbBytes << ", \"self_references\": " << (params.selfReferences ? "true" : "false")
+                 << ", \"roots\": " << roots << ", \"jobs\": " << jobs << ", \"run\": " << run
+                 << ", \"wall_s\": " << std::setprecision(3) << elapsed.count() << ", \"rows\": " << rows << ", \"bytes\": " << bytes
+                 << ", \"rows_per_s\": " << std::setprecision(1) << rows / elapsed.count()
+                 << ", \"mb_per_s\": " << std::setprecision(3) << bytes / elapsed.count() / (1 << 20)
+                 << ", \"metrics\": " << (metrics.empty() ? "null" : metrics) << "}\n";
+            std::ofstream out(results_file, std::ios::app);
+            out << line.str();
+
+            std::printf("run %zu: %.3fs, %llu rows, %.1f rows/s, %.3f MB/s\n", run, elapsed.count(), rows, rows / elapsed.count(), bytes / elapsed.count() / (1 << 20));
+        }
+    } catch(const std::exception& e) {
+        std::printf("Oops: %s\n", e.what());
+        return 1;
+    }
+}
@@ -0,0 +1,45 @@
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <string>
+
+#include "config.hpp"
+#include "pg.hpp"
+#include "synthetic.hpp"
+
+// Builds a synthetic FK schema and data set in the source database of .env and
+// the same empty schema in the destination, ready for an exscribo run.
+int main(int argc, char** argv)
+{
+    SyntheticParams params;
+    bool schema_only = false;
+    for(int i = 1; i < argc; i++) {
+        if(parseSyntheticArg(argc, argv, i, params)) continue;
+        if(std::strcmp(argv[i], "--schema-only") == 0) {
+            schema_only = true;
+            continue;
+        }
+        std::cerr << "Usage: exscribo-gen [options]\n" << SYNTHETIC_USAGE
+                  << "  --schema-only        create the tables without filling them\n";
+        return -1;
+    }
+
+    DBConfig config;
+    parseFileIntoConfig(".env", config);
+    try {
+        PgConnection source{config.source};
+        createSyntheticSchema(source, params);
+        if(!schema_only) {
+            fillSyntheticData(source, params);
+        }
+        PgConnection destination{config.destination};
+        createSyntheticSchema(destination, params);
+
+        size_t tables = syntheticTables(params).size();
+        std::cout << "Generated " << tables << " tables, " << (schema_only ? 0 : tables * params.rows) << " rows\n";
+        std::cout << "Root table: " << SYNTHETIC_ROOT << " (ids 1.." << params.rows << ")\n";
+    } catch(const std::exception& e) {
+        std::printf("Oops: %s\n", e.what());
+        return 1;
+    }
+}
@@ -0,0 +1,121 @@
+#include "synthetic.hpp"
+
+#include <cstdlib>
+#include <string>
+
+const char* SYNTHETIC_USAGE =
+    "  --depth <n>          levels of dependents below bench_root (default 3)\n"
+    "  --fanout <n>         dependent tables per table (default 2)\n"
+    "  --supporters <n>     supporter-only lookup tables (default 2)\n"
+    "  --rows <n>           rows per table, at least 1 (default 10000)\n"
+    "  --jsonb-bytes <n>    add a jsonb payload of about n bytes per row (default 0)\n"
+    "  --self-references    give tree tables a self-referencing FK\n";
+
+std::vector<SyntheticTable> syntheticTables(const SyntheticParams& params) {
+    std::vector<SyntheticTable> tables;
+    std::vector<std::string> lookups;
+    for(size_t i = 0; i < params.supporters; ++i) {
+        lookups.push_back("bench_lookup_" + std::to_string(i));
+        tables.push_back({lookups.back(), "", "", false});
+    }
+    size_t treeIndex = 0;
+    auto lookupFor = [&]() {
+        return lookups.empty() ? std::string() : lookups[treeIndex++ % lookups.size()];
+    };
+
+    tables.push_back({SYNTHETIC_ROOT, "", lookupFor(), true});
+    std::vector<std::string> level = { SYNTHETIC_ROOT };
+    for(size_t depth = 1; depth <= params.depth; ++depth) {
+        std::vector<std::string> next;
+        for(size_t p = 0; p < level.size(); ++p) {
+            for(size_t f = 0; f < params.fanout; ++f) {
+                next.push_back("bench_l" + std::to_string(depth) + "_" + std::to_string(next.size()));
+                tables.push_back({next.back(), level[p], lookupFor(), true});
+            }
+        }
+        level = std::move(next);
+    }
+    return tables;
+}
+
+void createSyntheticSchema(PgConnection& conn, const SyntheticParams& params) {
+    // Drop whatever a previous run with another shape left behind.
+    auto existing = conn.query("SELECT tablename FROM pg_tables WHERE schemaname = 'public' AND tablename LIKE 'bench\\_%';");
+    for(const auto& row : existing) {
+        conn.execute("DROP TABLE IF EXISTS " + quoteIdentifier(row.at(0)) + " CASCADE;");
+    }
+
+    for(const auto& table : syntheticTables(params)) {
+        const std::string name = quoteIdentifier(table.name);
+        std::string columns = "id bigint PRIMARY KEY";
+        if(!table.parent.empty()) {
+            columns += ", parent_id bigint NOT NULL REFERENCES " + quoteIdentifier(table.parent) + " (id)";
+        }
+        if(!table.lookup.empty()) {
+            columns += ", lookup_id bigint REFERENCES " + quoteIdentifier(table.lookup) + " (id)";
+        }
+        if(table.tree && params.selfReferences) {
+            columns += ", self_id bigint REFERENCES " + name + " (id)";
+        }
+        columns += ", label text NOT NULL, created_at timestamptz NOT NULL";
+        if(params.jsonbBytes > 0) {
+            columns += ", payload jsonb";
+        }
+        conn.execute("CREATE TABLE " + name + " (" + columns + ");");
+        // Real schemas index their FK columns; the traversal relies on it.
+        if(!table.parent.empty()) {
+            conn.execute("CREATE INDEX ON " + name + " (parent_id);");
+        }
+        if(!table.lookup.empty()) {
+            conn.execute("CREATE INDEX ON " + name + " (lookup_id);");
+        }
+    }
+}
+
+void fillSyntheticData(PgConnection& conn, const SyntheticParams& params) {
+    const std::string rows = std::to_string(params.rows);
+    // The multiplier is prime, so parents are spread evenly but not in id order.
+    for(const auto& table : syntheticTables(params)) {
+        std::string columns = "id", values = "g";
+        if(!table.parent.empty()) {
+            columns += ", parent_id";
+            values += ", 1 + (g * 7919) % " + rows;
+        }
+        if(!table.lookup.empty()) {
+            columns += ", lookup_id";
+            values += ", 1 + g % " + rows;
+        }
+        if(table.tree && params.selfReferences) {
+            // Chains of four rows: each points at the one before it.
+            columns += ", self_id";
+            values += ", CASE WHEN g % 4 = 1 THEN NULL ELSE g - 1 END";
+        }
+        columns += ", label, created_at";
+        values += ", " + quoteLiteral(table.name + " ") + " || g, timestamptz '2024-01-01' + g * interval '1 minute'";
+        if(params.jsonbBytes > 0) {
+            columns += ", payload";
+            values += ", jsonb_build_object('id', g, 'pad', repeat(md5(g::text), " + std::to_string((params.jsonbBytes + 31) / 32) + "))";
+        }
+        conn.execute("INSERT INTO " + quoteIdentifier(table.name) + " (" + columns + ") SELECT " + values + " FROM generate_series(1, " + rows + ") g;");
+    }
+    conn.execute("ANALYZE;");
+}
+
+bool parseSyntheticArg(int argc, char** argv, int& i, SyntheticParams& params) {
+    std::string arg = argv[i];
+    if(arg == "--self-references") {
+        params.selfReferences = true;
+        return true;
+    }
+    if(i + 1 >= argc) return false;
+    size_t* target = nullptr;
+    if(arg == "--depth") target = &params.depth;
+    else if(arg == "--fanout") target = &params.fanout;
+    else if(arg == "--supporters") target = &params.supporters;
+    else if(arg == "--rows") target = &params.rows;
+    else if(arg == "--jsonb-bytes") target = &params.jsonbBytes;
+    if(!target) return false;
+    *target = std::strtoull(argv[++i], nullptr, 10);
+    // Row ids are taken modulo the row count, so a table needs at least one row.
+    return target != &params.rows || params.rows > 0;
+}
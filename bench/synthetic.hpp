@@ -0,0 +1,46 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+#include "pg.hpp"
+
+// Shape of a generated FK schema. Tables form a tree under bench_root: every
+// table below depth has fanout dependents, and each tree table also references
+// one of the supporter-only lookup tables.
+struct SyntheticParams {
+    size_t depth = 3;
+    size_t fanout = 2;
+    size_t supporters = 2;          // lookup tables that only ever get referenced
+    size_t rows = 10000;            // per table
+    size_t jsonbBytes = 0;          // size of a padded jsonb payload column, 0 for none
+    bool selfReferences = false;    // tree tables get a self_id chaining rows together
+};
+
+struct SyntheticTable {
+    std::string name;
+    std::string parent;             // empty for the root and the lookup tables
+    std::string lookup;             // lookup table it references, empty when there are none
+    bool tree = false;              // false for the lookup tables
+};
+
+inline const std::string SYNTHETIC_ROOT = "bench_root";
+
+// Lookup tables first, then the tree level by level, so creating and filling
+// in this order never references a missing table.
+std::vector<SyntheticTable> syntheticTables(const SyntheticParams& params);
+
+// Drops any previous generated tables and creates the schema, empty.
+void createSyntheticSchema(PgConnection& conn, const SyntheticParams& params);
+
+// Fills an empty generated schema server side with generate_series, so the
+// client sends a handful of statements however many rows are asked for.
+// Data is deterministic: the same params always give the same rows.
+void fillSyntheticData(PgConnection& conn, const SyntheticParams& params);
+
+// Parses one generator flag at argv[i], advancing i past its value.
+// Returns false when argv[i] is not a generator flag, or --rows is below 1.
+bool parseSyntheticArg(int argc, char** argv, int& i, SyntheticParams& params);
+
+extern const char* SYNTHETIC_USAGE;
@@ -26,4 +26,35 @@ location("src/")
 files(srcFiles)
 removefiles({ excludeSrcFiles })
 includedirs({ pgfeIncludePath, structMappingIncludePath })
+links({ "pq", "pthread", "z" })
+
+-- Synthetic FK schema generator and the end-to-end benchmark driver. Both
+-- share the generator and reuse the tool's config and libpq wrapper.
+local benchSharedFiles = {
+	"bench/synthetic.cpp",
+	"bench/synthetic.hpp",
+	"src/config.cpp",
+	"src/pg.cpp",
+}
+
+project(projectName .. "-gen")
+kind(projectKind)
+language(lang)
+cppdialect(standard)
+targetdir("bin/%{cfg.buildcfg}")
+location("bench/")
+files(benchSharedFiles)
+files({ "bench/generate.cpp" })
+includedirs({ "src", pgfeIncludePath, structMappingIncludePath })
+links({ "pq" })
+
+project(projectName .. "-bench")
+kind(projectKind)
+language(lang)
+cppdialect(standard)
+targetdir("bin/%{cfg.buildcfg}")
+location("bench/")
+files(benchSharedFiles)
+files({ "bench/bench.cpp" })
+includedirs({ "src", pgfeIncludePath, structMappingIncludePath })
 links({ "pq" })
@@ -0,0 +1,193 @@
+#include "catalog.hpp"
+
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+namespace fs = std::filesystem;
+
+namespace {
+
+const char LIST_DELIMITER = '\x1F';
+const std::string CACHE_MAGIC = "exscribo-fkgraph 3";
+
+// One row per (constraint, column pair). unnest(conkey, confkey) keeps composite
+// keys paired up; for primary keys confkey is NULL and the foreign side stays empty.
+const std::string catalog_from_clause = R"(
+        FROM pg_constraint con
+        JOIN pg_class cl ON cl.oid = con.conrelid
+        JOIN pg_namespace ns ON ns.oid = cl.relnamespace
+        LEFT JOIN pg_class fcl ON fcl.oid = con.confrelid
+        LEFT JOIN pg_namespace fns ON fns.oid = fcl.relnamespace
+        CROSS JOIN LATERAL unnest(con.conkey, con.confkey) WITH ORDINALITY AS k(attnum, fattnum, ord)
+        JOIN pg_attribute att ON att.attrelid = con.conrelid AND att.attnum = k.attnum
+        LEFT JOIN pg_attribute fatt ON fatt.attrelid = con.confrelid AND fatt.attnum = k.fattnum
+        WHERE ns.nspname = 'public'
+        AND (con.contype = 'p' OR (con.contype = 'f' AND fns.nspname = 'public')))";
+
+const std::string catalog_query = R"(SELECT
+        con.contype::text,
+        con.conname::text,
+        cl.relname::text,
+        att.attname::text,
+        coalesce(fcl.relname::text, ''),
+        coalesce(fatt.attname::text, ''),
+        con.condeferrable::text)" + catalog_from_clause + R"(
+        ORDER BY con.contype, cl.relname, con.conname, k.ord)";
+
+const std::string fingerprint_query = R"(SELECT md5(coalesce(string_agg(
+        con.oid::text || ':' || con.xmin::text || ':' || con.contype || ':' || con.condeferrable::text || ':' || con.conname || ':' || cl.relname || ':' || att.attname
+            || ':' || coalesce(fcl.relname::text, '') || ':' || coalesce(fatt.attname::text, ''),
+        ',' ORDER BY con.oid, k.ord), '')))" + catalog_from_clause;
+
+std::string joinList(const std::vector<std::string>& values) {
+    std::string out;
+    for(size_t i = 0; i < values.size(); ++i) {
+        if(i != 0) out += LIST_DELIMITER;
+        out += values[i];
+    }
+    return out;
+}
+
+std::vector<std::string> splitList(const std::string& value, char delimiter) {
+    std::vector<std::string> out;
+    std::string item;
+    std::istringstream ss(value);
+    while(std::getline(ss, item, delimiter)) {
+        out.push_back(item);
+    }
+    return out;
+}
+
+} // namespace
+
+pgfe::Connection_options catalogConnectionOptions(const DatabaseInfo& info) {
+    return pgfe::Connection_options{}
+        .set(pgfe::Communication_mode::net)
+        .set_hostname(info.host)
+        .set_port(info.port)
+        .set_database(info.name)
+        .set_username(info.username)
+        .set_password(info.password)
+        .set_ssl_enabled(info.sslEnabled);
+}
+
+std::string catalogFingerprint(pgfe::Connection& conn) {
+    std::string fingerprint;
+    conn.execute([&](auto&& row)
+      {
+            using dmitigr::pgfe::to;
+            fingerprint = to<std::string>(row[0]);
+      }, fingerprint_query);
+    return fingerprint;
+}
+
+SchemaCatalog queryCatalog(pgfe::Connection& conn) {
+    SchemaCatalog catalog;
+    std::pair<std::string, std::string> last; // (constraint, table) of the previous row
+    conn.execute([&](auto&& row)
+      {
+            using dmitigr::pgfe::to;
+            std::string kind = to<std::string>(row[0]);
+            std::string constraint_name = to<std::string>(row[1]), table_name = to<std::string>(row[2]);
+            std::string col_name = to<std::string>(row[3]);
+            std::string foreign_table_name = to<std::string>(row[4]), foreign_col_name = to<std::string>(row[5]);
+            bool deferrable = to<std::string>(row[6]) == "true";
+
+            // Rows arrive ordered by kind, table, constraint and key position,
+            // so a constraint's columns are always adjacent.
+            bool new_constraint = last.first != constraint_name || last.second != table_name;
+            last = {constraint_name, table_name};
+            if(kind == "p") {
+                if(new_constraint) catalog.primaryKeys.push_back(PrimaryKey{table_name, {}});
+                catalog.primaryKeys.back().columns.push_back(col_name);
+                return;
+            }
+            if(new_constraint) {
+                ForeignKey fk;
+                fk.name = constraint_name;
+                fk.table = table_name;
+                fk.foreignTable = foreign_table_name;
+                fk.deferrable = deferrable;
+                catalog.foreignKeys.push_back(fk);
+            }
+            catalog.foreignKeys.back().columns.push_back(col_name);
+            catalog.foreignKeys.back().foreignColumns.push_back(foreign_col_name);
+      }, catalog_query);
+    return catalog;
+}
+
+bool readCatalogCache(const std::string& filePath, SchemaCatalog& catalog) {
+    std::ifstream ifs(filePath);
+    if(!ifs.good()) return false;
+
+    std::string line;
+    if(!std::getline(ifs, line) || line != CACHE_MAGIC) return false;
+    if(!std::getline(ifs, catalog.fingerprint)) return false;
+
+    catalog.foreignKeys.clear();
+    catalog.primaryKeys.clear();
+    while(std::getline(ifs, line)) {
+        std::vector<std::string> fields = splitList(line, '\t');
+        if(fields.size() == 3 && fields[0] == "p") {
+            PrimaryKey pk;
+            pk.table = fields[1];
+            pk.columns = splitList(fields[2], LIST_DELIMITER);
+            if(pk.columns.empty()) return false;
+            catalog.primaryKeys.push_back(pk);
+            continue;
+        }
+        if(fields.size() != 7 || fields[0] != "f") return false;
+        ForeignKey fk;
+        fk.name = fields[1];
+        fk.table = fields[2];
+        fk.columns = splitList(fields[3], LIST_DELIMITER);
+        fk.foreignTable = fields[4];
+        fk.foreignColumns = splitList(fields[5], LIST_DELIMITER);
+        fk.deferrable = fields[6] == "d";
+        if(fk.columns.empty() || fk.columns.size() != fk.foreignColumns.size()) return false;
+        catalog.foreignKeys.push_back(fk);
+    }
+    return true;
+}
+
+void writeCatalogCache(const std::string& filePath, const SchemaCatalog& catalog) {
+    // Write to a side file and rename so a concurrent run never reads a partial cache.
+    std::string tmpPath = filePath + ".tmp";
+    {
+        std::ofstream ofs(tmpPath, std::ios::trunc);
+        ofs << CACHE_MAGIC << '\n';
+        ofs << catalog.fingerprint << '\n';
+        for(const auto& pk : catalog.primaryKeys) {
+            ofs << "p\t" << pk.table << '\t' << joinList(pk.columns) << '\n';
+        }
+        for(const auto& fk : catalog.foreignKeys) {
+            ofs << "f\t" << fk.name << '\t' << fk.table << '\t' << joinList(fk.columns) << '\t'
+                << fk.foreignTable << '\t' << joinList(fk.foreignColumns) << '\t' << (fk.deferrable ? "d" : "-") << '\n';
+        }
+    }
+    fs::rename(tmpPath, filePath);
+}
+
+SchemaCatalog discoverCatalog(pgfe::Connection& conn, const std::string& cacheDir) {
+    if(cacheDir.empty()) {
+        return queryCatalog(conn);
+    }
+
+    std::string fingerprint = catalogFingerprint(conn);
+    std::string cachePath = (fs::path(cacheDir) / (fingerprint + ".fkgraph")).string();
+
+    SchemaCatalog catalog;
+    if(readCatalogCache(cachePath, catalog) && catalog.fingerprint == fingerprint) {
+        std::cout << "Schema cache hit: " << cachePath << '\n';
+        return catalog;
+    }
+
+    catalog = queryCatalog(conn);
+    catalog.fingerprint = fingerprint;
+    fs::create_directories(cacheDir);
+    writeCatalogCache(cachePath, catalog);
+    std::cout << "Schema cache written: " << cachePath << '\n';
+    return catalog;
+}
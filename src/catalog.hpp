@@ -0,0 +1,48 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "include/pgfe/pgfe.hpp"
+
+#include "config.hpp"
+
+namespace pgfe = dmitigr::pgfe;
+
+// One foreign key constraint, columns listed in constraint order.
+// table.columns[i] references foreignTable.foreignColumns[i].
+struct ForeignKey {
+    std::string name;
+    std::string table;                      // dependent (referencing) table
+    std::vector<std::string> columns;
+    std::string foreignTable;               // supporter (referenced) table
+    std::vector<std::string> foreignColumns;
+    bool deferrable = false;
+};
+
+struct PrimaryKey {
+    std::string table;
+    std::vector<std::string> columns;
+};
+
+struct SchemaCatalog {
+    std::string fingerprint;
+    std::vector<ForeignKey> foreignKeys;
+    std::vector<PrimaryKey> primaryKeys;
+};
+
+// pgfe options for the catalog connection to a database.
+pgfe::Connection_options catalogConnectionOptions(const DatabaseInfo& info);
+
+// Hash of the FK catalog computed server side. One round trip, 32 bytes back.
+std::string catalogFingerprint(pgfe::Connection& conn);
+
+// Pulls every FK and PK constraint of the public schema in a single pg_constraint query.
+SchemaCatalog queryCatalog(pgfe::Connection& conn);
+
+bool readCatalogCache(const std::string& filePath, SchemaCatalog& catalog);
+void writeCatalogCache(const std::string& filePath, const SchemaCatalog& catalog);
+
+// Returns the catalog from <cacheDir>/<fingerprint>.fkgraph when present,
+// otherwise queries it and writes the cache. An empty cacheDir disables caching.
+SchemaCatalog discoverCatalog(pgfe::Connection& conn, const std::string& cacheDir);
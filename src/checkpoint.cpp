@@ -0,0 +1,271 @@
+#include "checkpoint.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+
+#include <zlib.h>
+
+#include "pgcopy.hpp"
+
+namespace fs = std::filesystem;
+
+namespace {
+
+const char* MANIFEST_MAGIC = "exscribo-manifest 1";
+const char* MANIFEST_FILE = "manifest";
+const char* ROWS_MAGIC = "exscribo-rows 1";
+
+const char* statusName(TableStatus status) {
+    switch(status) {
+        case TableStatus::FETCHED: return "fetched";
+        case TableStatus::LOADED: return "loaded";
+        default: return "pending";
+    }
+}
+
+// A table name as a file name component: anything but letters, digits, '_'
+// and '-' is %-escaped, so quoted names with '/' or '..' stay inside the
+// checkpoint directory.
+std::string fileSafeName(const std::string& name) {
+    std::string out;
+    for(unsigned char c : name) {
+        if(std::isalnum(c) || c == '_' || c == '-') {
+            out += static_cast<char>(c);
+        } else {
+            char escaped[4];
+            std::snprintf(escaped, sizeof(escaped), "%%%02X", c);
+            out += escaped;
+        }
+    }
+    return out;
+}
+
+uint32_t extendChecksum(uint32_t crc, const char* data, size_t size) {
+    // crc32 takes a uInt length; feed huge buffers in pieces.
+    while(size > 0) {
+        uInt piece = static_cast<uInt>(std::min<size_t>(size, 1u << 30));
+        crc = crc32(crc, reinterpret_cast<const Bytef*>(data), piece);
+        data += piece;
+        size -= piece;
+    }
+    return crc;
+}
+
+} // namespace
+
+std::string planHash(const std::string& planText) {
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    for(unsigned char c : planText) {
+        hash ^= c;
+        hash *= 0x100000001b3ULL;
+    }
+    char hex[17];
+    std::snprintf(hex, sizeof(hex), "%016llx", static_cast<unsigned long long>(hash));
+    return hex;
+}
+
+Checkpoint::Checkpoint(std::string dir, std::string planHash, const Plan& plan, bool compress)
+    : dir(std::move(dir)), hash(std::move(planHash)), compress(compress), tables(plan.tables.size()), layouts(plan.tables.size()) {
+    for(size_t i = 0; i < plan.tables.size(); ++i) {
+        tables[i].table = plan.tables[i].name;
+        for(const auto& column : plan.tables[i].columns) {
+            layouts[i] += "column " + column.name + " " + column.type + "\n";
+        }
+    }
+}
+
+bool Checkpoint::load() {
+    std::lock_guard<std::mutex> lock(mutex);
+    std::ifstream ifs(fs::path(dir) / MANIFEST_FILE);
+    if(!ifs.good()) return false;
+
+    std::string line;
+    if(!std::getline(ifs, line) || line != MANIFEST_MAGIC) return false;
+    if(!std::getline(ifs, line) || line != "plan\t" + hash) return false;
+    if(!std::getline(ifs, line) || line.rfind("snapshot\t", 0) != 0) return false;
+    std::string snapshot = line.substr(9);
+
+    std::vector<TableCheckpoint> read;
+    while(std::getline(ifs, line)) {
+        std::istringstream fields(line);
+        TableCheckpoint entry;
+        std::string status;
+        if(!std::getline(fields, entry.table, '\t') || !std::getline(fields, status, '\t')) return false;
+        if(!(fields >> entry.rows >> entry.bytes >> entry.checksum)) return false;
+        entry.status = status == "loaded" ? TableStatus::LOADED : status == "fetched" ? TableStatus::FETCHED : TableStatus::PENDING;
+        read.push_back(entry);
+    }
+    if(read.size() != tables.size()) return false;
+    for(size_t i = 0; i < read.size(); ++i) {
+        if(read[i].table != tables[i].table) return false;
+    }
+    tables = std::move(read);
+    snapshotId = snapshot;
+    return true;
+}
+
+void Checkpoint::reset() {
+    std::lock_guard<std::mutex> lock(mutex);
+    std::error_code ignored;
+    for(size_t i = 0; i < tables.size(); ++i) {
+        tables[i].status = TableStatus::PENDING;
+        tables[i].rows = 0;
+        tables[i].bytes = 0;
+        tables[i].checksum = 0;
+        for(const char* suffix : { "", ".gz", ".tmp", ".gz.tmp" }) {
+            fs::remove(rowsPath(i) + suffix, ignored);
+        }
+    }
+    write();
+}
+
+void Checkpoint::setSnapshot(const std::string& id) {
+    std::lock_guard<std::mutex> lock(mutex);
+    snapshotId = id;
+    write();
+}
+
+TableStatus Checkpoint::status(size_t table) const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return tables[table].status;
+}
+
+std::string Checkpoint::rowsPath(size_t table) const {
+    return (fs::path(dir) / (std::to_string(table) + "_" + fileSafeName(tables[table].table) + ".pgcopy")).string();
+}
+
+void Checkpoint::saveRows(size_t table, const RowSet& rows, uint64_t rowCount) {
+    // The file is the fetched stream with its header swapped for one that
+    // describes it. gzip's transparent mode writes the uncompressed form, so
+    // both go through the same calls.
+    std::string path = rowsPath(table) + (compress ? ".gz" : "");
+    std::string header = copyHeader(std::string(ROWS_MAGIC) + "\ntable " + tables[table].table + "\nrows " + std::to_string(rowCount) + "\n" + layouts[table]);
+    uint32_t crc = extendChecksum(crc32(0, nullptr, 0), header.data(), header.size());
+    uint64_t bytes = header.size();
+    fs::create_directories(dir);
+    gzFile out = gzopen((path + ".tmp").c_str(), compress ? "wb1" : "wbT");
+    if(!out) throw std::runtime_error("cannot write checkpoint " + path);
+    bool ok = true;
+    auto put = [&](const char* data, size_t size) {
+        if(size > 0 && gzwrite(out, data, static_cast<unsigned>(size)) != static_cast<int>(size)) ok = false;
+    };
+    put(header.data(), header.size());
+    bool first = true;
+    rows.forEachBlock([&](const char* block, size_t size) {
+        size_t skip = first ? copyHeaderSize(block, size) : 0;
+        first = false;
+        crc = extendChecksum(crc, block + skip, size - skip);
+        bytes += size - skip;
+        put(block + skip, size - skip);
+    });
+    if(gzclose(out) != Z_OK || !ok) {
+        throw std::runtime_error("cannot write checkpoint " + path);
+    }
+    // The data file goes down before the manifest points at it; a leftover in
+    // the other form would shadow it on restore.
+    fs::rename(path + ".tmp", path);
+    std::error_code ignored;
+    fs::remove(compress ? rowsPath(table) : rowsPath(table) + ".gz", ignored);
+
+    std::lock_guard<std::mutex> lock(mutex);
+    tables[table].status = TableStatus::FETCHED;
+    tables[table].rows = rowCount;
+    tables[table].bytes = bytes;
+    tables[table].checksum = crc;
+    write();
+}
+
+bool Checkpoint::restoreRows(size_t table, RowSet& rows) const {
+    TableCheckpoint entry;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        entry = tables[table];
+    }
+    if(entry.status == TableStatus::PENDING) return false;
+    std::string path = rowsPath(table);
+    if(!fs::exists(path)) path += ".gz";
+    if(!fs::exists(path)) return false;
+    // gzread passes uncompressed files through as they are.
+    gzFile in = gzopen(path.c_str(), "rb");
+    if(!in) return false;
+    gzbuffer(in, 1 << 16);
+
+    // Append whole tuples only: consumers walk a RowSet block by block and
+    // expect no tuple to straddle two blocks. Rows go straight into the
+    // caller's set so they count against its memory budget and may spill.
+    rows.clear();
+    uint32_t crc = crc32(0, nullptr, 0);
+    uint64_t bytes = 0;
+    std::string buffer(RowSet::BLOCK_SIZE, '\0');
+    std::string carry;
+    bool valid = true, headerRead = false;
+    while(valid) {
+        int n = gzread(in, buffer.data(), static_cast<unsigned>(buffer.size()));
+        if(n < 0) valid = false;
+        if(n <= 0) break;
+        crc = extendChecksum(crc, buffer.data(), n);
+        bytes += n;
+        carry.append(buffer.data(), n);
+        size_t end = 0;
+        if(!headerRead) {
+            try {
+                end = copyHeaderSize(carry.data(), carry.size());
+            } catch(const std::exception&) {
+                valid = false;
+                break;
+            }
+            if(end == 0) continue;
+            std::string expected = std::string(ROWS_MAGIC) + "\ntable " + entry.table + "\nrows " + std::to_string(entry.rows) + "\n";
+            if(copyHeaderExtension(carry.data(), end).rfind(expected, 0) != 0) {
+                valid = false;
+                break;
+            }
+            rows.append(carry.data(), end);
+            headerRead = true;
+        }
+        size_t start = end;
+        while(true) {
+            size_t tuple = copyTupleSize(carry.data() + end, carry.size() - end);
+            if(tuple == 0) break;
+            end += tuple;
+        }
+        if(end > start) rows.append(carry.data() + start, end - start);
+        carry.erase(0, end);
+    }
+    gzclose(in);
+
+    if(!valid || !headerRead || !carry.empty() || bytes != entry.bytes || crc != entry.checksum) {
+        rows.clear();
+        return false;
+    }
+    return true;
+}
+
+void Checkpoint::markLoaded(size_t table) {
+    std::lock_guard<std::mutex> lock(mutex);
+    tables[table].status = TableStatus::LOADED;
+    write();
+}
+
+void Checkpoint::write() const {
+    // Same write-then-rename as the schema cache, so the manifest on disk is
+    // always a complete one.
+    fs::create_directories(dir);
+    fs::path path = fs::path(dir) / MANIFEST_FILE;
+    std::string tmpPath = path.string() + ".tmp";
+    {
+        std::ofstream ofs(tmpPath, std::ios::trunc);
+        ofs << MANIFEST_MAGIC << '\n';
+        ofs << "plan\t" << hash << '\n';
+        ofs << "snapshot\t" << snapshotId << '\n';
+        for(const auto& entry : tables) {
+            ofs << entry.table << '\t' << statusName(entry.status) << '\t' << entry.rows << '\t' << entry.bytes << '\t' << entry.checksum << '\n';
+        }
+    }
+    fs::rename(tmpPath, path);
+}
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "plan.hpp"
+#include "rowset.hpp"
+
+enum class TableStatus { PENDING, FETCHED, LOADED };
+
+struct TableCheckpoint {
+    std::string table;
+    TableStatus status = TableStatus::PENDING;
+    uint64_t rows = 0;
+    uint64_t bytes = 0;
+    uint32_t checksum = 0;      // crc32 of the table's file, uncompressed
+};
+
+// FNV-1a over everything that shapes a run, so a manifest is only reused by
+// the exact same plan, roots and load options.
+std::string planHash(const std::string& planText);
+
+// A run's progress on disk: each table's fetched rows in
+// <dir>/<n>_<table>.pgcopy (.pgcopy.gz when compressed, the table name
+// %-escaped) and a manifest with the plan hash, the snapshot the rows were
+// read under, and per table its status, row count, byte size and checksum. The manifest is rewritten
+// atomically after every change, so a crash leaves the last consistent state
+// behind. Safe to update from several workers.
+//
+// Row files are binary COPY streams whose header extension records the table,
+// row count and column layout, so COPY ... FROM '<file>' (FORMAT binary)
+// loads one directly.
+class Checkpoint {
+public:
+    Checkpoint(std::string dir, std::string planHash, const Plan& plan, bool compress = false);
+
+    // Reads the manifest. False, leaving everything pending, when there is
+    // none or it was written for a different plan.
+    bool load();
+
+    const std::string& snapshot() const { return snapshotId; }
+    // Forgets every fetched table, removing its file, so a fresh extraction
+    // never leaves rows of an older snapshot behind for a later --resume.
+    void reset();
+    void setSnapshot(const std::string& id);
+
+    TableStatus status(size_t table) const;
+
+    // Writes the rows to disk and marks the table fetched.
+    void saveRows(size_t table, const RowSet& rows, uint64_t rowCount);
+    // Reads a fetched table's rows back, compressed or not. False when the
+    // file is missing or does not match its header or the manifest's size and
+    // checksum.
+    bool restoreRows(size_t table, RowSet& rows) const;
+
+    void markLoaded(size_t table);
+
+private:
+    std::string dir;
+    std::string hash;
+    std::string snapshotId;
+    bool compress;
+    std::vector<TableCheckpoint> tables;
+    std::vector<std::string> layouts;   // per table, the "column <name> <type>" lines
+    mutable std::mutex mutex;
+
+    std::string rowsPath(size_t table) const;
+    void write() const;
+};
@@ -0,0 +1,34 @@
+#include "config.hpp"
+
+#include <cassert>
+#include <fstream>
+#include <iterator>
+#include <sstream>
+
+#include "include/struct_mapping/struct_mapping.h"
+
+void parseFileIntoConfig(const std::string fileName, DBConfig& config) {
+    // Assume file exists and is accessible
+    std::ifstream ifs(fileName);
+    assert(ifs.good());
+    std::string content( (std::istreambuf_iterator<char>(ifs) ), (std::istreambuf_iterator<char>()));
+    std::stringstream ssContent(content);
+
+    struct_mapping::reg(&DBConfig::source, "source");
+    struct_mapping::reg(&DBConfig::destination, "destination");
+    struct_mapping::reg(&DBConfig::tables, "tables");
+    struct_mapping::reg(&DatabaseInfo::host, "host");
+    struct_mapping::reg(&DatabaseInfo::port, "port");
+    struct_mapping::reg(&DatabaseInfo::name, "name");
+    struct_mapping::reg(&DatabaseInfo::username, "username");
+    struct_mapping::reg(&DatabaseInfo::password, "password");
+    struct_mapping::reg(&DatabaseInfo::sslEnabled, "sslEnabled");
+    struct_mapping::reg(&TableConfig::skip, "skip");
+    struct_mapping::reg(&TableConfig::excludeColumns, "excludeColumns");
+    struct_mapping::reg(&TableConfig::where, "where");
+    struct_mapping::reg(&TableConfig::edges, "edges");
+    struct_mapping::reg(&EdgeConfig::limit, "limit");
+    struct_mapping::reg(&EdgeConfig::samplePercent, "samplePercent");
+
+    struct_mapping::map_json_to_struct(config, ssContent);
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <map>
+#include <string>
+#include <vector>
+
+struct DatabaseInfo {
+    std::string host;
+    int port;
+    std::string name;
+    std::string username;
+    std::string password;
+    bool sslEnabled;
+};
+
+// Cap on the rows of a table reached down one FK edge, keyed in
+// TableConfig::edges by the referenced table the edge comes from.
+struct EdgeConfig {
+    int limit = 0;                  // at most this many rows per referenced row, 0 for no cap
+    double samplePercent = 100;     // random share of the rows across the edge
+};
+
+// Per-table rules from the "tables" section of .env, keyed by table name.
+struct TableConfig {
+    bool skip = false;                          // leave out the table and what is only reachable through it
+    std::vector<std::string> excludeColumns;    // neither fetched nor loaded; filled with their default
+    std::string where;                          // extra predicate on the rows reached going down
+    std::map<std::string, EdgeConfig> edges;
+};
+
+using TableRules = std::map<std::string, TableConfig>;
+
+struct DBConfig {
+    DatabaseInfo source;
+    DatabaseInfo destination;
+    TableRules tables;
+};
+
+void parseFileIntoConfig(const std::string fileName, DBConfig& config);
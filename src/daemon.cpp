@@ -0,0 +1,324 @@
+#include "daemon.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <iostream>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "catalog.hpp"
+#include "graph.hpp"
+#include "metrics.hpp"
+#include "plan.hpp"
+
+namespace {
+
+constexpr size_t MAX_JOB_LINE = 1 << 20;
+
+sockaddr_un socketAddress(const std::string& path) {
+    sockaddr_un address{};
+    address.sun_family = AF_UNIX;
+    if(path.size() >= sizeof(address.sun_path)) {
+        throw std::runtime_error("socket path too long: " + path);
+    }
+    std::memcpy(address.sun_path, path.c_str(), path.size() + 1);
+    return address;
+}
+
+// Reads up to the first newline. Empty when the peer sent nothing usable.
+std::string readLine(int fd) {
+    std::string line;
+    char buffer[4096];
+    while(line.size() < MAX_JOB_LINE) {
+        ssize_t n = recv(fd, buffer, sizeof(buffer), 0);
+        if(n <= 0) break;
+        line.append(buffer, n);
+        auto newline = line.find('\n');
+        if(newline != std::string::npos) {
+            line.resize(newline);
+            break;
+        }
+    }
+    if(!line.empty() && line.back() == '\r') line.pop_back();
+    return line;
+}
+
+// Clears the way for a new socket at path. Only a stale socket left by a
+// daemon that is gone is removed; any other file, or a socket another daemon
+// still accepts on, is an error.
+void removeStaleSocket(const std::string& path, const sockaddr_un& address) {
+    struct stat info;
+    if(lstat(path.c_str(), &info) != 0) {
+        if(errno == ENOENT) return;
+        throw std::runtime_error("cannot stat " + path + ": " + std::strerror(errno));
+    }
+    if(!S_ISSOCK(info.st_mode)) {
+        throw std::runtime_error(path + " exists and is not a socket");
+    }
+    int probe = socket(AF_UNIX, SOCK_STREAM, 0);
+    if(probe < 0) throw std::runtime_error("cannot create socket");
+    bool live = connect(probe, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) == 0;
+    close(probe);
+    if(live) {
+        throw std::runtime_error("another daemon is listening on " + path);
+    }
+    unlink(path.c_str());
+}
+
+void sendLine(int fd, const std::string& line) {
+    std::string out = line + "\n";
+    // The client may have gone away; that must not take the daemon down.
+    send(fd, out.data(), out.size(), MSG_NOSIGNAL);
+}
+
+struct Job {
+    int fd = -1;
+    std::string line;
+};
+
+// Jobs in arrival order, filled by the accepting thread.
+class JobQueue {
+public:
+    void push(Job job) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            jobs.push_back(std::move(job));
+        }
+        changed.notify_one();
+    }
+
+    Job pop() {
+        std::unique_lock<std::mutex> lock(mutex);
+        changed.wait(lock, [&]() { return !jobs.empty(); });
+        Job job = std::move(jobs.front());
+        jobs.pop_front();
+        return job;
+    }
+
+    // False, leaving job alone, when the queue is empty.
+    bool tryPop(Job& job) {
+        std::lock_guard<std::mutex> lock(mutex);
+        if(jobs.empty()) return false;
+        job = std::move(jobs.front());
+        jobs.pop_front();
+        return true;
+    }
+
+private:
+    std::deque<Job> jobs;
+    std::mutex mutex;
+    std::condition_variable changed;
+};
+
+// "<table> <id>...; <table> <id>..." into root tables, in order, and their ids.
+void parseRoots(const std::string& line, std::vector<std::string>& tables, std::unordered_map<std::string, std::vector<std::string>>& ids) {
+    std::istringstream groups(line);
+    std::string group;
+    while(std::getline(groups, group, ';')) {
+        std::istringstream fields(group);
+        std::string table, id;
+        if(!(fields >> table)) continue;
+        if(!ids.count(table)) tables.push_back(table);
+        auto& list = ids[table];
+        while(fields >> id) list.push_back(id);
+        if(list.empty()) throw std::runtime_error("root table " + table + " needs at least one id");
+    }
+    if(tables.empty()) throw std::runtime_error("expected <table> <id> [<id>...]");
+}
+
+} // namespace
+
+int serveDaemon(const DBConfig& config, const DaemonOptions& options) {
+    pgfe::Connection catalogConnection{catalogConnectionOptions(config.source)};
+    catalogConnection.connect();
+    RunConnections connections{config, options.jobs};
+
+    std::string fingerprint, columns_fingerprint;
+    SchemaGraph graph;
+    std::unordered_map<std::string, Plan> plans;    // by sorted root tables
+
+    sockaddr_un address = socketAddress(options.socketPath);
+    removeStaleSocket(options.socketPath, address);
+    int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+    if(listener < 0) throw std::runtime_error("cannot create socket");
+    // Anyone who can connect can copy data and stop the daemon, so the socket
+    // is created 0600, without a window in which it is open to other users.
+    mode_t previous_mask = umask(0177);
+    int bound = bind(listener, reinterpret_cast<sockaddr*>(&address), sizeof(address));
+    umask(previous_mask);
+    if(bound != 0 || chmod(options.socketPath.c_str(), 0600) != 0 || listen(listener, 64) != 0) {
+        close(listener);
+        throw std::runtime_error("cannot listen on " + options.socketPath + ": " + std::strerror(errno));
+    }
+    std::cout << "Listening on " << options.socketPath << '\n';
+
+    // Accepting runs beside the jobs so clients can queue while one runs.
+    // Each request is read on a thread of its own, so a client that is slow
+    // to send its line holds up no one else. Readers are counted so the
+    // daemon can wait for them before it returns. Only closing the listener
+    // ends the loop; a failed accept, such as running out of descriptors, is
+    // logged and retried with a growing pause.
+    JobQueue queue;
+    std::mutex readers_mutex;
+    std::condition_variable readers_done;
+    size_t readers = 0;
+    std::atomic<bool> closing{false};
+    std::thread acceptor([&]() {
+        auto backoff = std::chrono::milliseconds(10);
+        while(true) {
+            int client = accept(listener, nullptr, nullptr);
+            if(client < 0) {
+                if(closing) return;
+                if(errno == EINTR || errno == ECONNABORTED) continue;
+                std::cerr << "accept on " << options.socketPath << " failed: " << std::strerror(errno) << ", retrying\n";
+                std::this_thread::sleep_for(backoff);
+                backoff = std::min(backoff * 2, std::chrono::milliseconds(1000));
+                continue;
+            }
+            backoff = std::chrono::milliseconds(10);
+            {
+                std::lock_guard<std::mutex> lock(readers_mutex);
+                readers++;
+            }
+            std::thread([&, client]() {
+                timeval timeout{ 5, 0 };
+                setsockopt(client, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+                queue.push({ client, readLine(client) });
+                // Notified under the lock: once readers is 0 the daemon may
+                // return and take readers_done with it.
+                std::lock_guard<std::mutex> lock(readers_mutex);
+                readers--;
+                readers_done.notify_all();
+            }).detach();
+        }
+    });
+
+    Job stop;
+    while(true) {
+        Job job = queue.pop();
+        if(job.line == "shutdown") {
+            stop = std::move(job);
+            break;
+        }
+        auto start = std::chrono::steady_clock::now();
+        try {
+            std::vector<std::string> root_tables;
+            std::unordered_map<std::string, std::vector<std::string>> root_ids;
+            parseRoots(job.line, root_tables, root_ids);
+
+            // One round trip tells whether the cached graph and plans still hold.
+            std::string current;
+            try {
+                current = catalogFingerprint(catalogConnection);
+            } catch(const std::exception&) {
+                catalogConnection.disconnect();
+                catalogConnection.connect();
+                current = catalogFingerprint(catalogConnection);
+            }
+            if(current != fingerprint) {
+                graph = SchemaGraph::build(discoverCatalog(catalogConnection, options.schemaCacheDir));
+                plans.clear();
+                fingerprint = current;
+            }
+            // A plan also holds each table's columns for COPY, which change
+            // without any key changing.
+            std::string columns = columnsFingerprint(connections.coordinator);
+            if(columns != columns_fingerprint) {
+                plans.clear();
+                columns_fingerprint = columns;
+            }
+
+            std::sort(root_tables.begin(), root_tables.end());
+            std::string key;
+            for(const auto& table : root_tables) key += table + ",";
+            auto cached = plans.find(key);
+            if(cached == plans.end()) {
+                std::vector<TableId> roots;
+                for(const auto& root_table : root_tables) {
+                    auto id = graph.findTable(root_table);
+                    if(!id) {
+                        throw std::runtime_error("root table " + root_table + " has no primary or foreign keys in the public schema");
+                    }
+                    roots.push_back(*id);
+                }
+                Plan plan = buildPlan(graph, roots, config.tables);
+                for(const auto& warning : plan.warnings) {
+                    std::cout << job.line << ": warning " << warning << '\n';
+                }
+                describeColumns(plan, connections.coordinator);
+                cached = plans.emplace(key, std::move(plan)).first;
+            }
+
+            auto rootIdsOf = [&](const TablePlan& table) -> const std::vector<std::string>& {
+                static const std::vector<std::string> none;
+                auto ids = root_ids.find(table.name);
+                return ids == root_ids.end() ? none : ids->second;
+            };
+            Metrics metrics;
+            RunStats stats = executePlan(graph, cached->second, rootIdsOf, connections, metrics, options.run);
+
+            std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+            char reply[128];
+            std::snprintf(reply, sizeof(reply), "ok rows=%llu bytes=%llu ms=%.1f",
+                static_cast<unsigned long long>(stats.rows), static_cast<unsigned long long>(stats.bytes), elapsed.count());
+            std::cout << job.line << ": " << reply << '\n';
+            sendLine(job.fd, reply);
+        } catch(const std::exception& e) {
+            std::string message = e.what();
+            std::replace(message.begin(), message.end(), '\n', ' ');
+            std::cout << job.line << ": error " << message << '\n';
+            sendLine(job.fd, "error " + message);
+        }
+        close(job.fd);
+    }
+
+    // No new clients; requests already being read still reach the queue.
+    // Every job queued behind the shutdown is answered before it is confirmed.
+    closing = true;
+    shutdown(listener, SHUT_RDWR);
+    acceptor.join();
+    close(listener);
+    {
+        std::unique_lock<std::mutex> lock(readers_mutex);
+        readers_done.wait(lock, [&]() { return readers == 0; });
+    }
+    Job rest;
+    while(queue.tryPop(rest)) {
+        sendLine(rest.fd, "error shutting down");
+        close(rest.fd);
+    }
+    unlink(options.socketPath.c_str());
+    sendLine(stop.fd, "ok shutting down");
+    close(stop.fd);
+    return 0;
+}
+
+int submitJob(const std::string& socketPath, const std::string& job) {
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    sockaddr_un address = socketAddress(socketPath);
+    if(fd < 0 || connect(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0) {
+        std::cerr << "Cannot connect to " << socketPath << ": " << std::strerror(errno) << '\n';
+        if(fd >= 0) close(fd);
+        return 1;
+    }
+    sendLine(fd, job);
+    std::string reply = readLine(fd);
+    close(fd);
+    std::cout << (reply.empty() ? "error no reply" : reply) << '\n';
+    return reply.rfind("ok", 0) == 0 ? 0 : 1;
+}
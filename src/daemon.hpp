@@ -0,0 +1,26 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+#include "config.hpp"
+#include "executor.hpp"
+
+struct DaemonOptions {
+    std::string socketPath;
+    std::string schemaCacheDir;
+    size_t jobs = 4;
+    RunOptions run;
+};
+
+// Serves copy jobs on a Unix socket. Connections, the schema graph and a plan
+// per set of root tables stay warm between jobs; the catalog and column
+// fingerprints are probed per job and a changed schema drops the cached plans. Jobs queue up and
+// run one at a time. A job is one line of "<table> <id> [<id>...]" groups
+// separated by ';', answered with "ok rows=<n> bytes=<n> ms=<t>" or
+// "error <message>". A "shutdown" line stops the daemon once the jobs queued
+// before it have run; jobs queued after it are answered "error shutting down".
+int serveDaemon(const DBConfig& config, const DaemonOptions& options);
+
+// Sends one job line to a daemon and prints the reply. Returns the exit code.
+int submitJob(const std::string& socketPath, const std::string& job);
@@ -0,0 +1,116 @@
+#include "estimate.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <unordered_map>
+
+namespace {
+
+const char COLUMN_SEPARATOR = '\x1F';
+
+std::vector<std::string> splitColumns(const std::string& joined) {
+    std::vector<std::string> columns;
+    size_t start = 0;
+    while(start <= joined.size()) {
+        size_t end = joined.find(COLUMN_SEPARATOR, start);
+        if(end == std::string::npos) end = joined.size();
+        columns.push_back(joined.substr(start, end - start));
+        start = end + 1;
+    }
+    return columns;
+}
+
+} // namespace
+
+std::vector<TableEstimate> estimatePlan(PgConnection& conn, const Plan& plan, const RootIdsOf& rootIdsOf) {
+    std::vector<TableEstimate> estimates(plan.tables.size());
+
+    // reltuples is -1 for a table that was never vacuumed or analyzed.
+    std::unordered_map<std::string, double> tableRows;
+    for(const auto& row : conn.query("SELECT c.relname, c.reltuples FROM pg_class c JOIN pg_namespace n ON n.oid = c.relnamespace WHERE n.nspname = 'public' AND c.relkind IN ('r', 'p');")) {
+        tableRows[row.at(0)] = std::strtod(row.at(1).c_str(), nullptr);
+    }
+
+    conn.execute("BEGIN;");
+    try {
+        for(const auto& level : plan.extractLevels) {
+            for(const ExtractStep& step : level) {
+                const ComponentPlan& component = plan.components[step.component];
+                for(size_t index : component.members) {
+                    const TablePlan& table = plan.tables[index];
+                    TableEstimate& estimate = estimates[index];
+                    const std::string query = step.descent ? descentQuery(table, rootIdsOf) : table.joinQuery;
+                    const std::string explained = conn.query("EXPLAIN (FORMAT JSON) " + query + ";").at(0).at(0);
+                    const double rows = explainValue(explained, "Plan Rows", 0);
+                    if(!step.descent) {
+                        auto found = tableRows.find(table.name);
+                        estimate.tableRows = found == tableRows.end() ? -1 : found->second;
+                        estimate.rows = rows;
+                        estimate.cost = explainValue(explained, "Total Cost", 0);
+                        estimate.lowerBound = component.cyclic;
+                    }
+                    // The LIMIT is what the planner sees as the stand-in's row count.
+                    const long long limit = std::max<long long>(1, std::llround(rows));
+                    conn.execute("CREATE TEMP VIEW " + (step.descent ? downName(table.name) : tempName(table.name)) + " AS SELECT " + table.keyList + " FROM " + quoteIdentifier(table.name) + " LIMIT " + std::to_string(limit) + ";");
+                }
+                if(step.descent) continue;
+                for(size_t index : component.members) {
+                    const std::string explained = conn.query("EXPLAIN (FORMAT JSON) " + plan.tables[index].fetchQuery + ";").at(0).at(0);
+                    estimates[index].bytes = estimates[index].rows * explainValue(explained, "Plan Width", 0);
+                }
+            }
+        }
+    } catch(...) {
+        conn.execute("ROLLBACK;");
+        throw;
+    }
+    conn.execute("ROLLBACK;");
+    return estimates;
+}
+
+std::vector<UnindexedForeignKey> findUnindexedForeignKeys(PgConnection& conn, const SchemaGraph& graph, const Plan& plan) {
+    // Key columns of every index in the schema, in index order.
+    std::unordered_map<std::string, std::vector<std::vector<std::string>>> indexes;
+    for(const auto& row : conn.query(
+        "SELECT c.relname, array_to_string(ARRAY("
+        "    SELECT a.attname FROM unnest(i.indkey) WITH ORDINALITY AS k(attnum, ord)"
+        "    JOIN pg_attribute a ON a.attrelid = i.indrelid AND a.attnum = k.attnum"
+        "    ORDER BY k.ord), E'\\x1F') "
+        "FROM pg_index i "
+        "JOIN pg_class c ON c.oid = i.indrelid "
+        "JOIN pg_namespace n ON n.oid = c.relnamespace "
+        "WHERE n.nspname = 'public';")) {
+        indexes[row.at(0)].push_back(splitColumns(row.at(1)));
+    }
+
+    std::vector<UnindexedForeignKey> unindexed;
+    for(const TablePlan& table : plan.tables) {
+        for(ConstraintId id : graph.supporterEdges(table.table)) {
+            const Constraint& c = graph.constraint(id);
+            auto supporter = plan.indexOf.find(graph.tableName(c.foreignTable));
+            if(supporter == plan.indexOf.end()) continue;
+
+            std::vector<std::string> columns;
+            for(ColumnId column : graph.columnsOf(c)) {
+                columns.push_back(graph.columnName(column));
+            }
+            // An index serves the join when the FK columns lead it, in any order.
+            bool indexed = false;
+            for(const auto& index : indexes[table.name]) {
+                if(index.size() < columns.size()) continue;
+                indexed = std::is_permutation(columns.begin(), columns.end(), index.begin());
+                if(indexed) break;
+            }
+            if(indexed) continue;
+
+            const TablePlan& supporterPlan = plan.tables[supporter->second];
+            // The walk down looks the table up by these columns when it reads the
+            // supporter's key table; so does the downward closure inside a cycle.
+            bool used = std::find(table.descentInputs.begin(), table.descentInputs.end(), supporter->second) != table.descentInputs.end()
+                || (supporterPlan.component == table.component && plan.components[table.component].cyclic && table.directDescendant);
+            unindexed.push_back({table.name, columns, supporterPlan.name, used});
+        }
+    }
+    return unindexed;
+}
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "graph.hpp"
+#include "pg.hpp"
+#include "plan.hpp"
+
+// What the planner expects one table's extract step to select, by plan index.
+struct TableEstimate {
+    double tableRows = 0;       // pg_class.reltuples, the size of the whole table
+    double rows = 0;            // rows the extract query is expected to select
+    double bytes = 0;           // rows times the full row width
+    double cost = 0;            // total cost of the extract query
+    bool lowerBound = false;    // cycle member: the closure can only add rows
+};
+
+// An FK whose referencing columns are not the leading columns of any index.
+struct UnindexedForeignKey {
+    std::string table;
+    std::vector<std::string> columns;
+    std::string foreignTable;
+    bool used = false;          // some extract step joins the table on these columns
+};
+
+// EXPLAINs every descent and extract query in plan order without moving any
+// data. Each DOWN_ and TEMP_ key table is stood in for by a temp view capped at
+// the rows the previous EXPLAIN predicted, so later estimates build on earlier
+// ones the same way the real run does. Everything happens in a transaction
+// that is rolled back.
+std::vector<TableEstimate> estimatePlan(PgConnection& conn, const Plan& plan, const RootIdsOf& rootIdsOf);
+
+// Checks pg_index for every FK between planned tables, in one query.
+std::vector<UnindexedForeignKey> findUnindexedForeignKeys(PgConnection& conn, const SchemaGraph& graph, const Plan& plan);
@@ -0,0 +1,456 @@
+#include "executor.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <filesystem>
+#include <iostream>
+#include <memory>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include <unistd.h>
+
+#include "pipeline.hpp"
+#include "remap.hpp"
+#include "rowset.hpp"
+
+namespace fs = std::filesystem;
+
+using std::string, std::vector, std::unordered_map;
+
+void RunConnections::reset() {
+    coordinator.recover();
+    coordinator.execute("DISCARD TEMP;");
+    for(ConnectionPool* pool : { &sources, &destinations }) {
+        for(size_t i = 0; i < pool->size(); ++i) {
+            pool->at(i).recover();
+            pool->at(i).execute("DISCARD TEMP;");
+        }
+    }
+}
+
+namespace {
+
+RunStats run(const SchemaGraph& graph, const Plan& plan, const RootIdsOf& rootIdsOf, RunConnections& connections,
+    Metrics& metrics, const RunOptions& options, Checkpoint* checkpoint, const fs::path& spillDir) {
+    // down_sets and key_sets feed later extract steps, row_sets hold the full
+    // rows to load.
+    vector<RowSet> down_sets(plan.tables.size()), key_sets(plan.tables.size()), row_sets(plan.tables.size());
+
+    // Fetching and loading overlap: once the key sets are complete, full rows
+    // are fetched in load order, and a component loads as soon as its rows
+    // and its supporters are in. Its rows are dropped once loaded. Row sets
+    // share one memory budget. Past it, a fetch waits while loads are
+    // under way to free memory, and spills to disk when none are. Full rows
+    // travel as binary COPY, which is cheaper to produce and parse than text
+    // and smaller once spilled.
+    MemoryBudget budget{options.memoryLimitMb << 20};
+    LoadScheduler scheduler{plan, &budget};
+    budget.setDrainable([&]() { return scheduler.draining(); });
+    // Spill files are named by table index alone: a quoted table name may hold
+    // '/' or '..'.
+    for(size_t index = 0; index < plan.tables.size(); ++index) {
+        row_sets[index].setBudget(&budget, (spillDir / (std::to_string(index) + ".pgcopy")).string(), options.compress);
+    }
+
+    ConnectionPool& destinations = connections.destinations;
+
+    // With --remap every row gets a new key in the destination, assigned
+    // right before its component loads; rows are then rewritten as they
+    // stream in.
+    std::unique_ptr<Remapper> remapper;
+    if(options.remap) {
+        auto timer = metrics.time("remap");
+        remapper = std::make_unique<Remapper>(graph, plan, destinations.at(0));
+    }
+
+    // A resumed run reuses the fetched rows only if all of them survived:
+    // they were read under one snapshot, and mixing in reads from a new one
+    // would break referential consistency.
+    bool restored = false;
+    if(checkpoint && options.resume) {
+        auto timer = metrics.time("restore");
+        restored = true;
+        for(size_t index = 0; index < plan.tables.size() && restored; ++index) {
+            restored = checkpoint->restoreRows(index, row_sets[index]);
+        }
+        bool any_loaded = false;
+        for(size_t index = 0; index < plan.tables.size(); ++index) {
+            any_loaded = any_loaded || checkpoint->status(index) == TableStatus::LOADED;
+        }
+        if(!restored && any_loaded) {
+            throw std::runtime_error("checkpoint has loaded tables but lost fetched rows; clear the destination and run without --resume");
+        }
+        if(any_loaded && options.remap) {
+            throw std::runtime_error("cannot resume a partially loaded --remap run: the key maps of loaded tables are gone");
+        }
+        if(restored) {
+            std::cout << "Resuming with rows fetched under snapshot " << checkpoint->snapshot() << '\n';
+        } else {
+            for(auto& rows : row_sets) {
+                rows.clear();
+            }
+        }
+    }
+
+    std::atomic<uint64_t> loaded_rows{0}, loaded_bytes{0};
+    auto loadRows = [&](PgConnection& destination, const string& copyInSql, size_t index) {
+        return remapper ? remapper->copyIn(destination, copyInSql, index, row_sets[index]) : copyInFromRowSet(destination, copyInSql, row_sets[index]);
+    };
+
+    // A member with columns to patch goes through a staging copy: its rows
+    // are inserted with those columns NULL, and set once the cycle is in.
+    auto stageTable = [&](PgConnection& destination, const TablePlan& table, size_t index) {
+        const string stage = quoteIdentifier("STAGE_" + table.name);
+        destination.execute("CREATE TEMP TABLE " + stage + " (LIKE " + quoteIdentifier(table.name) + ") ON COMMIT DROP;");
+        loadRows(destination, "COPY " + stage + table.columnList + " FROM STDIN (FORMAT binary)", index);
+        string columns, values;
+        for(const auto& row : destination.query("SELECT attname FROM pg_attribute WHERE attrelid = " + quoteLiteral(quoteIdentifier(table.name)) + "::regclass AND attnum > 0 AND NOT attisdropped ORDER BY attnum;")) {
+            const string& column = row.at(0);
+            // Excluded columns are left to their default.
+            if(std::find(table.excludedColumns.begin(), table.excludedColumns.end(), column) != table.excludedColumns.end()) continue;
+            if(!columns.empty()) { columns += ", "; values += ", "; }
+            columns += quoteIdentifier(column);
+            bool patched = std::find(table.patchColumns.begin(), table.patchColumns.end(), column) != table.patchColumns.end();
+            values += patched ? "NULL" : quoteIdentifier(column);
+        }
+        destination.execute("INSERT INTO " + quoteIdentifier(table.name) + " (" + columns + ") SELECT " + values + " FROM " + stage + ";");
+    };
+    auto patchTable = [&](PgConnection& destination, const TablePlan& table) {
+        const string stage = quoteIdentifier("STAGE_" + table.name);
+        string sets, match;
+        for(const auto& column : table.patchColumns) {
+            if(!sets.empty()) sets += ", ";
+            sets += quoteIdentifier(column) + " = s." + quoteIdentifier(column);
+        }
+        for(const auto& column : table.primaryKey) {
+            if(!match.empty()) match += " AND ";
+            match += "t." + quoteIdentifier(column) + " = s." + quoteIdentifier(column);
+        }
+        destination.execute("UPDATE " + quoteIdentifier(table.name) + " t SET " + sets + " FROM " + stage + " s WHERE " + match + ";");
+    };
+
+    // Loads a component's members in order, then patches the ones staged
+    // with NULLs. The caller owns the transaction.
+    auto loadComponent = [&](PgConnection& destination, const ComponentPlan& component) {
+        if(remapper) {
+            // Keys of the component's supporters were assigned when those loaded.
+            for(size_t index : component.members) {
+                auto timer = metrics.time("assign-keys", plan.tables[index].name);
+                remapper->assignKeys(index, row_sets[index], destination);
+            }
+        }
+        for(size_t index : component.members) {
+            const TablePlan& table = plan.tables[index];
+            auto timer = metrics.time("load", table.name);
+            if(table.patchColumns.empty()) {
+                timer.bytes(loadRows(destination, "COPY " + quoteIdentifier(table.name) + table.columnList + " FROM STDIN (FORMAT binary)", index));
+            } else {
+                stageTable(destination, table, index);
+                timer.bytes(row_sets[index].bytes());
+            }
+            timer.rows(destination.lastRowCount());
+            loaded_rows += destination.lastRowCount();
+            loaded_bytes += row_sets[index].bytes();
+        }
+        for(size_t index : component.members) {
+            if(!plan.tables[index].patchColumns.empty()) {
+                auto timer = metrics.time("patch", plan.tables[index].name);
+                patchTable(destination, plan.tables[index]);
+                timer.rows(destination.lastRowCount());
+            }
+        }
+        // The rows are in the destination's transaction; give their memory back.
+        for(size_t index : component.members) {
+            std::cout << "Loaded table: " << plan.tables[index].name << " (" << row_sets[index].bytes() << " bytes"
+                      << (row_sets[index].spilled() ? ", spilled" : "") << ")\n";
+            row_sets[index].clear();
+        }
+    };
+    // Components a resumed run already committed are skipped.
+    auto alreadyLoaded = [&](const ComponentPlan& component) {
+        if(!checkpoint) return false;
+        for(size_t index : component.members) {
+            if(checkpoint->status(index) != TableStatus::LOADED) return false;
+        }
+        return true;
+    };
+    auto markLoaded = [&](const ComponentPlan& component) {
+        if(!checkpoint) return;
+        for(size_t index : component.members) {
+            checkpoint->markLoaded(index);
+        }
+    };
+
+    for(size_t c = 0; c < plan.components.size(); ++c) {
+        if(alreadyLoaded(plan.components[c])) scheduler.skip(c);
+    }
+    if(restored) {
+        for(size_t index = 0; index < plan.tables.size(); ++index) {
+            scheduler.fetched(index);
+        }
+    }
+
+    // The loader runs beside extraction and takes components as the
+    // scheduler releases them.
+    std::exception_ptr load_error;
+    std::thread loader([&]() {
+        try {
+            auto loadTimer = metrics.time("load");
+            if(options.singleTransaction) {
+                // Everything goes in on one connection and commits or rolls back
+                // as a whole, so a failure leaves the destination untouched.
+                PgConnection& destination = destinations.at(0);
+                destination.execute("BEGIN;");
+                try {
+                    // replica skips FK triggers (and user triggers) entirely; it
+                    // needs superuser. Otherwise deferrable FKs check at commit.
+                    destination.execute(options.replicaRole ? "SET LOCAL session_replication_role = replica;" : "SET CONSTRAINTS ALL DEFERRED;");
+
+                    // Secondary indexes are rebuilt once instead of maintained per
+                    // row. Indexes behind a PK or constraint stay: FKs need them.
+                    vector<string> index_definitions;
+                    if(options.rebuildIndexes) {
+                        vector<string> names;
+                        for(const auto& table : plan.tables) {
+                            names.push_back(table.name);
+                        }
+                        auto timer = metrics.time("drop-indexes");
+                        for(const auto& row : destination.query(
+                            "SELECT i.indexrelid::regclass::text, pg_get_indexdef(i.indexrelid) "
+                            "FROM pg_index i "
+                            "JOIN pg_class c ON c.oid = i.indrelid "
+                            "JOIN pg_namespace n ON n.oid = c.relnamespace "
+                            "WHERE n.nspname = 'public' AND c.relname = ANY(" + quoteArrayLiteral(names) + "::text[]) AND NOT i.indisprimary "
+                            "AND NOT EXISTS (SELECT 1 FROM pg_constraint con WHERE con.conindid = i.indexrelid);")) {
+                            destination.execute("DROP INDEX " + row.at(0) + ";");
+                            index_definitions.push_back(row.at(1));
+                        }
+                        timer.rows(index_definitions.size());
+                    }
+
+                    scheduler.run(destinations, 1, [&](size_t c, PgConnection& destination) {
+                        loadComponent(destination, plan.components[c]);
+                    });
+                    if(scheduler.failed()) {
+                        throw std::runtime_error("extraction failed, load rolled back");
+                    }
+
+                    for(const auto& definition : index_definitions) {
+                        auto timer = metrics.time("rebuild-index");
+                        destination.execute(definition + ";");
+                    }
+                    if(!index_definitions.empty()) {
+                        std::cout << "Rebuilt " << index_definitions.size() << " indexes\n";
+                    }
+                } catch(...) {
+                    destination.execute("ROLLBACK;");
+                    throw;
+                }
+                auto timer = metrics.time("commit");
+                destination.execute("COMMIT;");
+                for(const auto& component : plan.components) {
+                    markLoaded(component);
+                }
+            } else {
+                // One transaction per component. A cycle's members go in
+                // together with constraints deferred to commit.
+                scheduler.run(destinations, destinations.size(), [&](size_t c, PgConnection& destination) {
+                    const ComponentPlan& component = plan.components[c];
+                    destination.execute("BEGIN;");
+                    try {
+                        if(component.cyclic) {
+                            destination.execute("SET CONSTRAINTS ALL DEFERRED;");
+                        }
+                        loadComponent(destination, component);
+                    } catch(...) {
+                        destination.execute("ROLLBACK;");
+                        throw;
+                    }
+                    {
+                        auto timer = metrics.time("commit", plan.tables[component.members[0]].name);
+                        destination.execute("COMMIT;");
+                    }
+                    markLoaded(component);
+                });
+            }
+        } catch(...) {
+            load_error = std::current_exception();
+            scheduler.abort();
+        }
+    });
+
+    try {
+        if(!restored) {
+            // The coordinator exports its snapshot and every worker attaches to it,
+            // so all of them read the same consistent state of the source.
+            PgConnection& source = connections.coordinator;
+            source.execute("BEGIN ISOLATION LEVEL REPEATABLE READ;");
+            string snapshot_id = source.query("SELECT pg_export_snapshot();").at(0).at(0);
+            if(checkpoint) {
+                // Nothing fetched before may be restored alongside what this
+                // extraction fetches.
+                checkpoint->reset();
+                checkpoint->setSnapshot(snapshot_id);
+            }
+            ConnectionPool& sources = connections.sources;
+            // Per session, the DOWN_ and TEMP_ key tables it holds.
+            unordered_map<PgConnection*, vector<bool>> downs_in_session, temps_in_session;
+            for(size_t w = 0; w < sources.size(); ++w) {
+                sources.at(w).execute("BEGIN ISOLATION LEVEL REPEATABLE READ;");
+                sources.at(w).execute("SET TRANSACTION SNAPSHOT " + quoteLiteral(snapshot_id) + ";");
+                downs_in_session[&sources.at(w)].assign(plan.tables.size(), false);
+                temps_in_session[&sources.at(w)].assign(plan.tables.size(), false);
+            }
+
+            // Key tables get an index on the primary key and fresh stats, temp
+            // tables are never auto-analyzed.
+            auto indexKeyTable = [&](PgConnection& worker, const TablePlan& table, const string& name) {
+                if(!table.primaryKey.empty()) {
+                    string cols;
+                    for(const auto& col : table.primaryKey) {
+                        if(!cols.empty()) cols += ", ";
+                        cols += quoteIdentifier(col);
+                    }
+                    worker.execute("CREATE INDEX ON " + name + " (" + cols + ");");
+                }
+                worker.execute("ANALYZE " + name + ";");
+            };
+
+            // Key sets extracted by another worker are pushed into this session once.
+            auto ensureKeyTable = [&](PgConnection& worker, size_t index, bool descent) {
+                vector<bool>& held = (descent ? downs_in_session : temps_in_session).at(&worker);
+                if(held[index]) return;
+                const TablePlan& table = plan.tables[index];
+                const string name = descent ? downName(table.name) : tempName(table.name);
+                auto timer = metrics.time("temp-load", table.name);
+                worker.execute("CREATE TEMP TABLE " + name + " AS SELECT " + table.keyList + " FROM " + quoteIdentifier(table.name) + " WHERE false;");
+                timer.bytes(copyInFromRowSet(worker, "COPY " + name + " FROM STDIN", (descent ? down_sets : key_sets)[index]));
+                timer.rows(worker.lastRowCount());
+                indexKeyTable(worker, table, name);
+                held[index] = true;
+            };
+
+            // A step runs on one worker: every member's key table is seeded
+            // from the key tables of earlier steps, then a cycle's closure grows
+            // the seeds server side before the key sets are read back.
+            auto runStep = [&](PgConnection& worker, const ComponentPlan& component, bool descent) {
+                for(size_t input : descent ? component.descentInputs : component.inputs) {
+                    ensureKeyTable(worker, input, descent);
+                }
+                for(size_t index : component.members) {
+                    // A direct descendant's final rows start from its walk down.
+                    if(!descent && plan.tables[index].directDescendant) ensureKeyTable(worker, index, true);
+                }
+                for(size_t index : component.members) {
+                    const TablePlan& table = plan.tables[index];
+                    const string name = descent ? downName(table.name) : tempName(table.name);
+                    auto timer = metrics.time(descent ? "descent" : "extract", table.name);
+                    string create = "CREATE TEMP TABLE " + name + " AS " + (descent ? descentQuery(table, rootIdsOf) : table.joinQuery);
+                    if(options.serverTimings) {
+                        ServerTiming timing = explainAnalyze(worker, create);
+                        timer.serverMs(timing.executionMs);
+                        timer.rows(timing.rows);
+                    } else {
+                        worker.execute(create + ";");
+                        timer.rows(worker.lastRowCount());
+                    }
+                    indexKeyTable(worker, table, name);
+                    (descent ? downs_in_session : temps_in_session).at(&worker)[index] = true;
+                }
+                const string& closure = descent ? component.descentClosure : component.closure;
+                if(!closure.empty()) {
+                    string members;
+                    for(size_t index : component.members) {
+                        members += (members.empty() ? "" : ",") + plan.tables[index].name;
+                    }
+                    auto timer = metrics.time("closure", members);
+                    worker.execute(closure);
+                    for(size_t index : component.members) {
+                        worker.execute("ANALYZE " + (descent ? downName(plan.tables[index].name) : tempName(plan.tables[index].name)) + ";");
+                    }
+                }
+                for(size_t index : component.members) {
+                    const string name = descent ? downName(plan.tables[index].name) : tempName(plan.tables[index].name);
+                    auto timer = metrics.time("key-copy", plan.tables[index].name);
+                    timer.bytes(copyOutToRowSet(worker, "COPY " + name + " TO STDOUT", (descent ? down_sets : key_sets)[index]));
+                    timer.rows(worker.lastRowCount());
+                }
+            };
+
+            // Direct descendants are first walked down into DOWN_ key tables.
+            // The final key sets follow dependents first, so a supporter's is
+            // only complete near the end. Only keys move until then.
+            auto extractTimer = std::make_unique<Metrics::Timer>(metrics, "extract", "");
+            for(const auto& level : plan.extractLevels) {
+                parallelFor(sources, level.size(), [&](size_t i, PgConnection& worker) {
+                    runStep(worker, plan.components[level[i].component], level[i].descent);
+                });
+                for(const ExtractStep& step : level) {
+                    if(step.descent) continue;
+                    for(size_t index : plan.components[step.component].members) {
+                        std::cout << "Processed table: " << plan.tables[index].name << " (" << key_sets[index].bytes() << " key bytes)\n";
+                    }
+                }
+            }
+
+            // Full rows are then fetched in load order, supporters first,
+            // deduplicated by the table's key set, and handed to the loader, so
+            // a component loads while the ones after it are still being fetched.
+            parallelFor(sources, plan.tables.size(), [&](size_t index, PgConnection& worker) {
+                // With a checkpoint, fetching carries on past a failed load so
+                // every table is on disk and --resume can retry the load.
+                if(!checkpoint && scheduler.failed()) {
+                    throw std::runtime_error("load failed, extraction stopped");
+                }
+                ensureKeyTable(worker, index, false);
+                auto timer = metrics.time("fetch", plan.tables[index].name);
+                timer.bytes(copyOutToRowSet(worker, "COPY (" + plan.tables[index].fetchQuery + ") TO STDOUT (FORMAT binary)", row_sets[index]));
+                timer.rows(worker.lastRowCount());
+                if(checkpoint) {
+                    checkpoint->saveRows(index, row_sets[index], worker.lastRowCount());
+                    // Nothing will load the rows any more; the file holds them.
+                    if(scheduler.failed()) row_sets[index].clear();
+                }
+                scheduler.fetched(index);
+            });
+            for(size_t w = 0; w < sources.size(); ++w) {
+                sources.at(w).execute("COMMIT;");
+            }
+            source.execute("COMMIT;");
+        }
+    } catch(...) {
+        // The loader may be waiting on tables that will never come.
+        scheduler.abort();
+        loader.join();
+        if(load_error) std::rethrow_exception(load_error);
+        throw;
+    }
+    loader.join();
+    if(load_error) std::rethrow_exception(load_error);
+    return { loaded_rows, loaded_bytes };
+}
+
+} // namespace
+
+RunStats executePlan(const SchemaGraph& graph, const Plan& plan, const RootIdsOf& rootIdsOf, RunConnections& connections,
+    Metrics& metrics, const RunOptions& options, Checkpoint* checkpoint) {
+    // Spill files go into a directory of this run's own, so removing it
+    // afterwards never touches anything else under options.spillDir.
+    static std::atomic<uint64_t> runs{0};
+    const fs::path spillDir = fs::path(options.spillDir) / ("exscribo-" + std::to_string(getpid()) + "-" + std::to_string(runs++));
+    std::error_code ignored;
+    try {
+        RunStats stats = run(graph, plan, rootIdsOf, connections, metrics, options, checkpoint, spillDir);
+        connections.reset();
+        fs::remove_all(spillDir, ignored);
+        return stats;
+    } catch(...) {
+        // The first error is the one worth reporting.
+        try { connections.reset(); } catch(const std::exception&) {}
+        fs::remove_all(spillDir, ignored);
+        throw;
+    }
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#include "checkpoint.hpp"
+#include "config.hpp"
+#include "graph.hpp"
+#include "metrics.hpp"
+#include "pg.hpp"
+#include "plan.hpp"
+#include "pool.hpp"
+
+struct RunOptions {
+    bool serverTimings = false;         // EXPLAIN ANALYZE the extract statements
+    bool remap = false;
+    bool singleTransaction = false;
+    bool replicaRole = false;
+    bool rebuildIndexes = false;
+    size_t memoryLimitMb = 2048;
+    std::string spillDir;               // each run spills into its own subdirectory
+    bool compress = false;              // gzip spilled blocks and checkpoint files
+    bool resume = false;                // the checkpoint holds a manifest for this plan
+};
+
+struct RunStats {
+    uint64_t rows = 0;                  // loaded into the destination
+    uint64_t bytes = 0;
+};
+
+// Everything a run talks to: the source coordinator that exports the snapshot,
+// the extraction workers and the loaders. Opened once and reused across runs.
+struct RunConnections {
+    RunConnections(const DBConfig& config, size_t jobs)
+        : coordinator(config.source), sources(config.source, jobs), destinations(config.destination, jobs) {}
+
+    PgConnection coordinator;
+    ConnectionPool sources;
+    ConnectionPool destinations;
+
+    // Leaves every session idle and without temp tables, ready for the next run.
+    void reset();
+};
+
+// Copies the rows the plan selects: extracts them under one exported snapshot
+// and loads each component as soon as it can go in. With a checkpoint, fetched
+// rows and loaded components are recorded, and options.resume picks up from
+// it. The connections are reset afterwards, also when the run fails.
+RunStats executePlan(const SchemaGraph& graph, const Plan& plan, const RootIdsOf& rootIdsOf, RunConnections& connections,
+    Metrics& metrics, const RunOptions& options, Checkpoint* checkpoint = nullptr);
@@ -0,0 +1,220 @@
+#include "graph.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <queue>
+
+uint32_t Interner::intern(const std::string& name) {
+    auto [it, inserted] = ids.try_emplace(name, static_cast<uint32_t>(names.size()));
+    if(inserted) names.push_back(name);
+    return it->second;
+}
+
+std::optional<uint32_t> Interner::find(const std::string& name) const {
+    auto it = ids.find(name);
+    if(it == ids.end()) return std::nullopt;
+    return it->second;
+}
+
+namespace {
+
+// Turns per-table item lists into CSR offsets + a flat id array.
+void buildCsr(const std::vector<std::vector<uint32_t>>& lists, std::vector<uint32_t>& offsets, std::vector<uint32_t>& ids) {
+    offsets.assign(lists.size() + 1, 0);
+    for(size_t i = 0; i < lists.size(); ++i) {
+        offsets[i + 1] = offsets[i] + static_cast<uint32_t>(lists[i].size());
+    }
+    ids.clear();
+    ids.reserve(offsets.back());
+    for(const auto& list : lists) {
+        ids.insert(ids.end(), list.begin(), list.end());
+    }
+}
+
+} // namespace
+
+SchemaGraph SchemaGraph::build(const SchemaCatalog& catalog) {
+    SchemaGraph graph;
+    for(const auto& fk : catalog.foreignKeys) {
+        Constraint c;
+        c.table = graph.tables.intern(fk.table);
+        c.foreignTable = graph.tables.intern(fk.foreignTable);
+        c.columnsBegin = static_cast<uint32_t>(graph.localColumns.size());
+        c.columnCount = static_cast<uint32_t>(fk.columns.size());
+        c.deferrable = fk.deferrable;
+        for(size_t i = 0; i < fk.columns.size(); ++i) {
+            graph.localColumns.push_back(graph.columns.intern(fk.columns[i]));
+            graph.foreignColumns.push_back(graph.columns.intern(fk.foreignColumns[i]));
+        }
+        graph.constraints.push_back(c);
+    }
+    for(const auto& pk : catalog.primaryKeys) {
+        graph.tables.intern(pk.table);
+    }
+
+    std::vector<std::vector<uint32_t>> supporters(graph.tables.size()), dependents(graph.tables.size()), primaryKeys(graph.tables.size());
+    for(ConstraintId id = 0; id < graph.constraints.size(); ++id) {
+        supporters[graph.constraints[id].table].push_back(id);
+        dependents[graph.constraints[id].foreignTable].push_back(id);
+    }
+    for(const auto& pk : catalog.primaryKeys) {
+        auto& columns = primaryKeys[*graph.tables.find(pk.table)];
+        for(const auto& column : pk.columns) {
+            columns.push_back(graph.columns.intern(column));
+        }
+    }
+    buildCsr(supporters, graph.supporterOffsets, graph.supporterIds);
+    buildCsr(dependents, graph.dependentOffsets, graph.dependentIds);
+    buildCsr(primaryKeys, graph.primaryKeyOffsets, graph.primaryKeyColumns);
+    return graph;
+}
+
+std::vector<bool> directDescendants(const SchemaGraph& graph, const std::vector<TableId>& roots, const std::vector<bool>& excluded) {
+    std::vector<bool> reached(graph.tableCount(), false);
+    auto blocked = [&](TableId table) { return !excluded.empty() && excluded[table]; };
+    std::queue<TableId> queue;
+    for(TableId root : roots) {
+        reached[root] = true;
+        queue.push(root);
+    }
+    while(!queue.empty()) {
+        TableId curr = queue.front();
+        queue.pop();
+        for(ConstraintId id : graph.dependentEdges(curr)) {
+            TableId dependent = graph.constraint(id).table;
+            if(reached[dependent] || blocked(dependent)) continue;
+            reached[dependent] = true;
+            queue.push(dependent);
+        }
+    }
+    return reached;
+}
+
+std::vector<TableId> copiedTables(const SchemaGraph& graph, const std::vector<bool>& direct, const std::vector<bool>& excluded) {
+    std::vector<bool> visited = excluded.empty() ? std::vector<bool>(graph.tableCount(), false) : excluded;
+    std::vector<TableId> order;
+    std::queue<TableId> queue;
+    for(TableId table = 0; table < direct.size(); ++table) {
+        if(direct[table]) queue.push(table);
+    }
+    while(!queue.empty()) {
+        TableId curr = queue.front();
+        queue.pop();
+        if(visited[curr]) continue;
+        visited[curr] = true;
+        order.push_back(curr);
+        for(ConstraintId id : graph.supporterEdges(curr)) {
+            queue.push(graph.constraint(id).foreignTable);
+        }
+    }
+    return order;
+}
+
+Components stronglyConnectedComponents(const SchemaGraph& graph, const std::vector<TableId>& tables) {
+    const uint32_t UNVISITED = UINT32_MAX;
+    Components components;
+    components.componentOf.assign(graph.tableCount(), Components::NONE);
+
+    std::vector<bool> included(graph.tableCount(), false);
+    for(TableId table : tables) {
+        included[table] = true;
+    }
+    std::vector<uint32_t> index(graph.tableCount(), UNVISITED), lowlink(graph.tableCount(), 0);
+    std::vector<bool> onStack(graph.tableCount(), false);
+    std::vector<TableId> stack;
+    uint32_t nextIndex = 0;
+
+    // Explicit DFS frames: (table, position in its dependent edge list).
+    std::vector<std::pair<TableId, size_t>> frames;
+    for(TableId start : tables) {
+        if(index[start] != UNVISITED) continue;
+        frames.push_back({start, 0});
+        index[start] = lowlink[start] = nextIndex++;
+        stack.push_back(start);
+        onStack[start] = true;
+
+        while(!frames.empty()) {
+            auto& [table, position] = frames.back();
+            auto edges = graph.dependentEdges(table);
+            if(position < edges.size()) {
+                TableId next = graph.constraint(edges[position++]).table;
+                if(!included[next]) continue;
+                if(index[next] == UNVISITED) {
+                    index[next] = lowlink[next] = nextIndex++;
+                    stack.push_back(next);
+                    onStack[next] = true;
+                    frames.push_back({next, 0});
+                } else if(onStack[next]) {
+                    lowlink[table] = std::min(lowlink[table], index[next]);
+                }
+                continue;
+            }
+
+            TableId done = table;
+            frames.pop_back();
+            if(!frames.empty()) {
+                TableId parent = frames.back().first;
+                lowlink[parent] = std::min(lowlink[parent], lowlink[done]);
+            }
+            if(lowlink[done] != index[done]) continue;
+
+            uint32_t id = static_cast<uint32_t>(components.members.size());
+            std::vector<TableId>& members = components.members.emplace_back();
+            TableId member;
+            do {
+                member = stack.back();
+                stack.pop_back();
+                onStack[member] = false;
+                components.componentOf[member] = id;
+                members.push_back(member);
+            } while(member != done);
+            // Tarjan pops in reverse discovery order; keep members in discovery order.
+            std::reverse(members.begin(), members.end());
+
+            bool selfReference = false;
+            for(ConstraintId edge : graph.dependentEdges(done)) {
+                if(graph.constraint(edge).table == done) selfReference = true;
+            }
+            components.cyclic.push_back(members.size() > 1 || selfReference);
+        }
+    }
+    return components;
+}
+
+std::vector<std::vector<uint32_t>> topoSort(const SchemaGraph& graph, const Components& components) {
+    const auto& componentOf = components.componentOf;
+    // One count per constraint, so several FKs to the same supporter are fine.
+    std::vector<uint32_t> remaining(components.members.size(), 0);
+    for(uint32_t id = 0; id < components.members.size(); ++id) {
+        for(TableId table : components.members[id]) {
+            for(ConstraintId edge : graph.supporterEdges(table)) {
+                uint32_t supporter = componentOf[graph.constraint(edge).foreignTable];
+                if(supporter != Components::NONE && supporter != id) remaining[id]++;
+            }
+        }
+    }
+
+    std::vector<std::vector<uint32_t>> levels;
+    std::vector<uint32_t> S;
+    for(uint32_t id = 0; id < components.members.size(); ++id) {
+        if(remaining[id] == 0) S.push_back(id);
+    }
+    size_t sorted = 0;
+    while(!S.empty()) {
+        std::vector<uint32_t> next;
+        for(uint32_t curr : S) {
+            for(TableId table : components.members[curr]) {
+                for(ConstraintId edge : graph.dependentEdges(table)) {
+                    uint32_t dependent = componentOf[graph.constraint(edge).table];
+                    if(dependent == Components::NONE || dependent == curr) continue;
+                    if(--remaining[dependent] == 0) next.push_back(dependent);
+                }
+            }
+        }
+        sorted += S.size();
+        levels.push_back(std::move(S));
+        S = std::move(next);
+    }
+    assert(sorted == components.members.size());
+    return levels;
+}
@@ -0,0 +1,105 @@
+#pragma once
+
+#include <cstdint>
+#include <optional>
+#include <span>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "catalog.hpp"
+
+using TableId = uint32_t;
+using ColumnId = uint32_t;
+using ConstraintId = uint32_t;
+
+// Maps names to dense ids and back.
+class Interner {
+public:
+    uint32_t intern(const std::string& name);
+    std::optional<uint32_t> find(const std::string& name) const;
+    const std::string& name(uint32_t id) const { return names[id]; }
+    size_t size() const { return names.size(); }
+
+private:
+    std::vector<std::string> names;
+    std::unordered_map<std::string, uint32_t> ids;
+};
+
+// One FK constraint. Its column pairs live in SchemaGraph's column arrays at
+// [columnsBegin, columnsBegin + columnCount).
+struct Constraint {
+    TableId table;          // dependent (referencing) table
+    TableId foreignTable;   // supporter (referenced) table
+    uint32_t columnsBegin;
+    uint32_t columnCount;
+    bool deferrable;
+};
+
+// The FK graph with interned table and column names and CSR adjacency.
+// Every constraint is an edge carrying its full column list, so composite keys
+// and several FKs between the same pair of tables are all kept.
+class SchemaGraph {
+public:
+    static SchemaGraph build(const SchemaCatalog& catalog);
+
+    size_t tableCount() const { return tables.size(); }
+    const std::string& tableName(TableId table) const { return tables.name(table); }
+    std::optional<TableId> findTable(const std::string& name) const { return tables.find(name); }
+    const std::string& columnName(ColumnId column) const { return columns.name(column); }
+
+    const Constraint& constraint(ConstraintId id) const { return constraints[id]; }
+    // Referencing side and referenced side of a constraint, pairwise.
+    std::span<const ColumnId> columnsOf(const Constraint& c) const { return { localColumns.data() + c.columnsBegin, c.columnCount }; }
+    std::span<const ColumnId> foreignColumnsOf(const Constraint& c) const { return { foreignColumns.data() + c.columnsBegin, c.columnCount }; }
+
+    // Constraints where table is the dependent, i.e. edges to its supporters.
+    std::span<const ConstraintId> supporterEdges(TableId table) const { return edges(supporterOffsets, supporterIds, table); }
+    // Constraints where table is the supporter, i.e. edges to its dependents.
+    std::span<const ConstraintId> dependentEdges(TableId table) const { return edges(dependentOffsets, dependentIds, table); }
+
+    // Empty when the table has no primary key.
+    std::span<const ColumnId> primaryKey(TableId table) const { return edges(primaryKeyOffsets, primaryKeyColumns, table); }
+
+private:
+    Interner tables;
+    Interner columns;
+    std::vector<Constraint> constraints;
+    std::vector<ColumnId> localColumns;
+    std::vector<ColumnId> foreignColumns;
+    std::vector<uint32_t> supporterOffsets, dependentOffsets, primaryKeyOffsets;
+    std::vector<ConstraintId> supporterIds, dependentIds;
+    std::vector<ColumnId> primaryKeyColumns;
+
+    static std::span<const uint32_t> edges(const std::vector<uint32_t>& offsets, const std::vector<uint32_t>& ids, TableId table) {
+        return { ids.data() + offsets[table], offsets[table + 1] - offsets[table] };
+    }
+};
+
+// Tables reachable from the roots by following supporter -> dependent edges.
+// Tables marked in excluded, by TableId, are never entered.
+std::vector<bool> directDescendants(const SchemaGraph& graph, const std::vector<TableId>& roots, const std::vector<bool>& excluded = {});
+
+// The direct descendants and every table they reference, transitively: the
+// only tables a copy can take rows from. Again without entering excluded tables.
+std::vector<TableId> copiedTables(const SchemaGraph& graph, const std::vector<bool>& direct, const std::vector<bool>& excluded = {});
+
+// Strongly connected components of the FK graph restricted to a set of tables.
+// A self-referencing table or an FK cycle forms one component and is planned,
+// extracted and loaded as a unit; every other table is a component of its own.
+struct Components {
+    static constexpr uint32_t NONE = UINT32_MAX;
+
+    std::vector<std::vector<TableId>> members;
+    std::vector<bool> cyclic;               // more than one member, or a self-reference
+    std::vector<uint32_t> componentOf;      // by TableId, NONE outside the set
+};
+
+// Tarjan's algorithm, iterative so deep FK chains cannot overflow the stack.
+Components stronglyConnectedComponents(const SchemaGraph& graph, const std::vector<TableId>& tables);
+
+// Kahn's algorithm over the condensation, one level at a time. Every component
+// in a level only depends on components in earlier levels, so a level can be
+// loaded concurrently. Edges inside a component and to tables outside the set
+// are ignored.
+std::vector<std::vector<uint32_t>> topoSort(const SchemaGraph& graph, const Components& components);
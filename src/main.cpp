@@ -1,6 +1,7 @@
 #include "include/pgfe/data.hpp"
 #include "include/pgfe/exceptions.hpp"
 #include "include/pgfe/pgfe.hpp"
+#include <algorithm>
 #include <cassert>
 #include <chrono>
 #include <cstdio>
@@ -8,185 +9,33 @@
 #include <filesystem>
 #include <fstream>
 #include <iostream>
+#include <memory>
 #include <string>
 #include <unordered_set>
 #include <iterator>
-#include "include/struct_mapping/struct_mapping.h"
+#include "catalog.hpp"
+#include "checkpoint.hpp"
+#include "config.hpp"
+#include "daemon.hpp"
+#include "estimate.hpp"
+#include "executor.hpp"
+#include "graph.hpp"
+#include "metrics.hpp"
+#include "pg.hpp"
+#include "plan.hpp"
 
 namespace fs = std::filesystem;
 
 namespace pgfe = dmitigr::pgfe;
-using std::string, std::vector, std::unordered_map, std::unordered_set, std::queue;
-
-const char DELIMITER = '\x1F';
-
-
-// Overload the << operator for std::vector
-template <typename T>
-std::ostream& operator<<(std::ostream& os, const std::vector<T>& vec) {
-    os << "[";
-    for (size_t i = 0; i < vec.size(); ++i) {
-        os << vec[i];
-        if (i != vec.size() - 1) {
-            os << ", "; // Add a comma and space between elements
-        }
-    }
-    os << "]";
-    return os;
-}
-
-struct CopyFromSupporters {
-    std::unordered_map<std::string, std::string> tableToCol;
-    std::unordered_map<std::string, std::string> tableToFilePath;
-};
-
-struct CopyFromDependent {
-    std::string tableName;
-    std::string filePath;
-};
-
-struct CopyFromDependents {
-    std::unordered_map<std::string, std::string> tableToCol;
-    std::unordered_map<std::string, std::string> tableToFilePath;
-};
-
-struct CopyFromSupporter {
-    std::string tableName;
-    std::string filePath;
-};
-
-enum PGDataType { NUMERIC, INTEGER, BIGINT, BOOLEAN, CHARACTERVARYING, TEXT, JSONB, TIMESTAMPNOTIMEZONE, DATE, OTHER };
-
-struct DatabaseInfo {
-    std::string host;
-    int port;
-    std::string name;
-    std::string username;
-    std::string password;
-    bool sslEnabled;
-};
-
-struct DBConfig {
-    DatabaseInfo source;
-    DatabaseInfo destination;
-};
-
-struct ColInfo {
-    bool isNullable;
-    PGDataType dataType;
-    int index;
-};
-
-struct RawColumn {
-    std::string name;
-    int index;
-};
-
-
-void parseFileIntoConfig(const std::string fileName, DBConfig& config) {
-    // Assume file exists and is accessible
-    std::ifstream ifs(fileName);
-    assert(ifs.good());
-    std::string content( (std::istreambuf_iterator<char>(ifs) ), (std::istreambuf_iterator<char>()));
-    std::stringstream ssContent(content);
-
-    struct_mapping::reg(&DBConfig::source, "source");
-    struct_mapping::reg(&DBConfig::destination, "destination");
-    struct_mapping::reg(&DatabaseInfo::host, "host");
-    struct_mapping::reg(&DatabaseInfo::port, "port");
-    struct_mapping::reg(&DatabaseInfo::name, "name");
-    struct_mapping::reg(&DatabaseInfo::username, "username");
-    struct_mapping::reg(&DatabaseInfo::password, "password");
-    struct_mapping::reg(&DatabaseInfo::sslEnabled, "sslEnabled");
-
-    struct_mapping::map_json_to_struct(config, ssContent);
-}
-
-std::string dependent_query = R"(SELECT
-        tc.table_name as "tableName", 
-        kcu.column_name, 
-        ccu.table_name AS foreign_table_name,
-        ccu.column_name AS foreign_column_name 
-        FROM information_schema.table_constraints AS tc 
-        JOIN information_schema.key_column_usage AS kcu
-        ON tc.constraint_name = kcu.constraint_name
-        AND tc.table_schema = kcu.table_schema
-        JOIN information_schema.constraint_column_usage AS ccu
-        ON ccu.constraint_name = tc.constraint_name
-        WHERE tc.constraint_type = 'FOREIGN KEY'
-        AND tc.table_schema='public'
-        AND ccu.table_name = )";
-
-std::string supporter_query = R"(SELECT
-        tc.table_name as "tableName", 
-        kcu.column_name, 
-        ccu.table_name AS foreign_table_name,
-        ccu.column_name AS foreign_column_name 
-        FROM information_schema.table_constraints AS tc 
-        JOIN information_schema.key_column_usage AS kcu
-        ON tc.constraint_name = kcu.constraint_name
-        AND tc.table_schema = kcu.table_schema
-        JOIN information_schema.constraint_column_usage AS ccu
-        ON ccu.constraint_name = tc.constraint_name
-        WHERE tc.constraint_type = 'FOREIGN KEY'
-        AND tc.table_schema='public'
-        AND tc.table_name =)";
+using std::string, std::vector, std::unordered_map, std::unordered_set;
 
 std::string valuesFromVector(const std::vector<std::string>& vec, const std::string& delimiter = ",") {
     std::stringstream s;
-    copy(vec.begin(), vec.end(), std::ostream_iterator<std::string>(s, ","));
-    return s.str().substr(0, s.str().length() - 1);
-}
-
-struct Table {
-    string name;
-    bool direct_descendant = false;
-    unordered_map<string, string> supporters; // table -> col
-    unordered_map<string, string> dependents; // table -> col
-};
-
-// Overload the << operator for Table
-std::ostream& operator<<(std::ostream& os, const Table& table) {
-    const std::string red = "\033[31m";
-    const std::string reset = "\033[0m";
-    os << red << "Table Name: " << reset << table.name << "\n";
-    os << "Supporters:\n";
-    for (const auto& supporter : table.supporters) {
-        os << "  " << supporter.first << " -> " << supporter.second << "\n";
-    }
-    os << "Dependents:\n";
-    for (const auto& dependent : table.dependents) {
-        os << "  " << dependent.first << " -> " << dependent.second << "\n";
-    }
-    return os;
-}
-
-std::vector<std::string> topoSort(
-    std::unordered_map<std::string, Table> tables,
-    std::string root_table
-) {
-    std::vector<std::string> L;
-    std::queue<Table*> S;
-    for(auto& table : tables) {
-        if(table.second.supporters.empty()) {
-            S.push(&table.second);
-        }
+    for(size_t i = 0; i < vec.size(); ++i) {
+        if(i != 0) s << delimiter;
+        s << vec[i];
     }
-    while(!S.empty()) {
-        Table* curr = S.front();
-        S.pop();
-        L.push_back(curr->name);
-        for(auto it = curr->dependents.begin(); it != curr->dependents.end(); ) {
-            Table& m = tables[it->first];
-            it = curr->dependents.erase(it);
-            m.supporters.erase(curr->name);
-            if(m.supporters.empty()) {
-                S.push(&m);
-            }
-        }
-    }
-    assert(L.size() == tables.size());
-    return L;
+    return s.str();
 }
 
 int main(int argc, char** argv)
@@ -195,272 +44,288 @@ int main(int argc, char** argv)
     parseFileIntoConfig(".env", config);
     std::cout << config.source.host << " - " << config.source.port << " - " << config.source.name << " - " << config.source.username << " - " << config.source.password << " - "  << config.source.sslEnabled << '\n';
     std::cout << "Params: \n";
-    if(argc != 3) {
-        std::cerr << "Must have 2 input args.\n";
+    string schema_cache_dir = ".exscribo_cache";
+    size_t jobs = 4;
+    string roots_file;
+    string metrics_file, trace_file;
+    bool plan_only = false;
+    bool remap = false;
+    bool single_transaction = false, replica_role = false, rebuild_indexes = false;
+    string checkpoint_dir;
+    bool resume = false;
+    size_t memory_limit_mb = 2048;
+    bool compress = false;
+    string spill_dir = fs::temp_directory_path().string();
+    string daemon_socket, submit_socket;
+    vector<string> positional;
+    for(int i = 1; i < argc; i++) {
+        string arg = argv[i];
+        if(arg == "--no-schema-cache") {
+            schema_cache_dir.clear();
+        } else if(arg == "--schema-cache-dir" && i + 1 < argc) {
+            schema_cache_dir = argv[++i];
+        } else if(arg == "--jobs" && i + 1 < argc) {
+            jobs = std::max(1, std::atoi(argv[++i]));
+        } else if(arg == "--roots-file" && i + 1 < argc) {
+            roots_file = argv[++i];
+        } else if(arg == "--metrics" && i + 1 < argc) {
+            metrics_file = argv[++i];
+        } else if(arg == "--trace" && i + 1 < argc) {
+            trace_file = argv[++i];
+        } else if(arg == "--plan") {
+            plan_only = true;
+        } else if(arg == "--remap") {
+            remap = true;
+        } else if(arg == "--single-transaction") {
+            single_transaction = true;
+        } else if(arg == "--replica") {
+            // Only meaningful around one load transaction.
+            single_transaction = replica_role = true;
+        } else if(arg == "--rebuild-indexes") {
+            single_transaction = rebuild_indexes = true;
+        } else if(arg == "--checkpoint") {
+            if(checkpoint_dir.empty()) checkpoint_dir = "query_order_results";
+        } else if(arg == "--checkpoint-dir" && i + 1 < argc) {
+            checkpoint_dir = argv[++i];
+        } else if(arg == "--resume") {
+            resume = true;
+            if(checkpoint_dir.empty()) checkpoint_dir = "query_order_results";
+        } else if(arg == "--memory-limit" && i + 1 < argc) {
+            memory_limit_mb = std::max(1, std::atoi(argv[++i]));
+        } else if(arg == "--spill-dir" && i + 1 < argc) {
+            spill_dir = argv[++i];
+        } else if(arg == "--compress") {
+            compress = true;
+        } else if(arg == "--daemon" && i + 1 < argc) {
+            daemon_socket = argv[++i];
+        } else if(arg == "--submit" && i + 1 < argc) {
+            submit_socket = argv[++i];
+        } else {
+            positional.push_back(arg);
+        }
+    }
+    // Every root table seeds the same traversal; its ids are fetched with one
+    // WHERE id = ANY(...) and shared rows are deduplicated across roots.
+    vector<string> root_tables;
+    unordered_map<string, vector<string>> root_ids;
+    auto addRoot = [&](const string& table, const string& id) {
+        if(!root_ids.count(table)) root_tables.push_back(table);
+        root_ids[table].push_back(id);
+    };
+    if(!positional.empty()) {
+        for(size_t i = 1; i < positional.size(); ++i) {
+            addRoot(positional[0], positional[i]);
+        }
+    }
+    if(!roots_file.empty()) {
+        std::ifstream ifs(roots_file);
+        if(!ifs.good()) {
+            std::cerr << "Cannot read roots file " << roots_file << '\n';
+            return -1;
+        }
+        string line;
+        while(std::getline(ifs, line)) {
+            std::istringstream fields(line);
+            string table, id;
+            if(!(fields >> table) || table[0] == '#') continue;
+            if(!(fields >> id)) {
+                std::cerr << "Roots file line needs <table> <id>: " << line << '\n';
+                return -1;
+            }
+            addRoot(table, id);
+        }
+    }
+    RunOptions run_options;
+    run_options.remap = remap;
+    run_options.singleTransaction = single_transaction;
+    run_options.replicaRole = replica_role;
+    run_options.rebuildIndexes = rebuild_indexes;
+    run_options.memoryLimitMb = memory_limit_mb;
+    run_options.spillDir = spill_dir;
+    run_options.compress = compress;
+    if(!daemon_socket.empty()) {
+        if(plan_only || !checkpoint_dir.empty() || !metrics_file.empty() || !trace_file.empty() || !root_tables.empty()) {
+            std::cerr << "--daemon takes its roots from submitted jobs and does not support --plan, --checkpoint, --metrics or --trace\n";
+            return -1;
+        }
+        DaemonOptions daemon_options;
+        daemon_options.socketPath = daemon_socket;
+        daemon_options.schemaCacheDir = schema_cache_dir;
+        daemon_options.jobs = jobs;
+        daemon_options.run = run_options;
+        try {
+            return serveDaemon(config, daemon_options);
+        } catch(const std::exception& e) {
+            std::printf("Oops: %s\n", e.what());
+            return 1;
+        }
+    }
+    if(root_tables.empty()) {
+        std::cerr << "Usage: exscribo [options] <root_table> <root_id> [<root_id>...]\n"
+                  << "       exscribo [options] --roots-file <file>   (one \"<table> <id>\" per line)\n"
+                  << "       exscribo --plan ...   estimate the run without copying anything\n"
+                  << "       exscribo [options] --daemon <socket>   serve copy jobs on a Unix socket\n"
+                  << "       exscribo --submit <socket> <root_table> <root_id>...   run a copy on a daemon\n";
         return -1;
     }
-    string root_table = argv[1];
-    string root_id = argv[2];
+    if(!submit_socket.empty()) {
+        string job;
+        for(const auto& table : root_tables) {
+            job += (job.empty() ? "" : "; ") + table;
+            for(const auto& id : root_ids[table]) job += " " + id;
+        }
+        return submitJob(submit_socket, job);
+    }
     for(int i = 0; i < argc; i++) {
         std::cout << argv[i] <<  '\n';
     }
     std::cout << '\n';
     auto beforeTime = std::chrono::steady_clock::now();
+    // Spans are always recorded. Server-side timings need EXPLAIN ANALYZE
+    // around the extract statements, so those are only taken when asked for.
+    Metrics metrics;
+    const bool server_timings = !metrics_file.empty() || !trace_file.empty();
+    auto writeMetrics = [&]() {
+        if(!metrics_file.empty()) metrics.writeSummary(metrics_file);
+        if(!trace_file.empty()) metrics.writeTrace(trace_file);
+    };
     try {
-        pgfe::Connection conn{pgfe::Connection_options{}
-        .set(pgfe::Communication_mode::net)
-        .set_hostname(config.source.host)
-        .set_port(config.source.port)
-        .set_database(config.source.name)
-        .set_username(config.source.username)
-        .set_password(config.source.password)
-        .set_ssl_enabled(config.source.sslEnabled)};
+        pgfe::Connection conn{catalogConnectionOptions(config.source)};
         conn.connect();
 
-        unordered_map<string, unordered_map<string, unordered_map<string, string>>> fkey_map, inv_fkey_map;
-        unordered_set<string> visited_tables;
-
-        unordered_map<string, Table> table_info;
-
-        queue<string> queue; 
-        queue.push(root_table);
-        table_info[root_table].name = root_table;
-        table_info[root_table].direct_descendant = true; // root table is always a direct descendant
-        while(!queue.empty()) {
-            string curr_table = queue.front();
-            queue.pop();
-            if(visited_tables.count(curr_table)) {
-                continue;
-            } else {
-                visited_tables.insert(curr_table);
-            }
-            table_info[curr_table].name = curr_table;
-            string get_dependents_query = dependent_query + "'" + curr_table + "'";
-            conn.execute([&](auto&& row)
-              {
-                    using dmitigr::pgfe::to;
-                    string dependent_table_name = to<std::string>(row[0]), dependent_table_col_name = to<string>(row[1]); 
-                    string supporter_table_name = to<std::string>(row[2]), supporter_table_col_name = to<string>(row[3]);
-
-                    fkey_map[supporter_table_name][dependent_table_name][supporter_table_col_name] = dependent_table_col_name; //fkey[S][D][S.col] = D.col
-                    inv_fkey_map[supporter_table_name][dependent_table_name][dependent_table_col_name] = supporter_table_col_name; // fkey[S][D][D.col] = S.col
-
-                    table_info[dependent_table_name].supporters[supporter_table_name] = supporter_table_col_name;
-                    table_info[supporter_table_name].dependents[dependent_table_name] = dependent_table_col_name;
-
-                    table_info[dependent_table_name].direct_descendant = table_info[dependent_table_name].direct_descendant || table_info[supporter_table_name].direct_descendant;
-                    queue.push(dependent_table_name);
-              }, get_dependents_query);
-
-            string get_supporters_query = supporter_query + "'" + curr_table + "'";
-            conn.execute([&](auto&& row)
-             {
-                    using dmitigr::pgfe::to;
-                    string dependent_table_name = to<std::string>(row[0]), dependent_table_col_name = to<string>(row[1]);
-                    string supporter_table_name = to<std::string>(row[2]), supporter_table_col_name = to<string>(row[3]);
-
-                    table_info[dependent_table_name].supporters[supporter_table_name] = supporter_table_col_name;
-                    table_info[supporter_table_name].dependents[dependent_table_name] = dependent_table_col_name;
-
-                    queue.push(supporter_table_name);
-             }, get_supporters_query
-            );
+        // Whole FK catalog in one pg_constraint query, or only the fingerprint
+        // probe on a cache hit. Planning runs over the interned graph.
+        SchemaCatalog catalog;
+        {
+            auto timer = metrics.time("discovery");
+            catalog = discoverCatalog(conn, schema_cache_dir);
+            timer.rows(catalog.foreignKeys.size());
         }
-
-        vector<string> sorted_table_names = topoSort(table_info, root_table);
-        vector<Table> direct_descendants, non_direct_descendants;
-        for(auto table : sorted_table_names) {
-            if (table_info[table].direct_descendant) {
-                direct_descendants.push_back(table_info[table]);
-            } else {
-                non_direct_descendants.push_back(table_info[table]);
+        conn.disconnect();
+        auto planTimer = std::make_unique<Metrics::Timer>(metrics, "plan", "");
+        SchemaGraph graph = SchemaGraph::build(catalog);
+
+        vector<TableId> roots;
+        for(const auto& root_table : root_tables) {
+            auto id = graph.findTable(root_table);
+            if(!id) {
+                throw std::runtime_error("root table " + root_table + " has no primary or foreign keys in the public schema");
             }
+            roots.push_back(*id);
         }
+        Plan plan = buildPlan(graph, roots, config.tables);
+        for(const auto& warning : plan.warnings) {
+            std::cerr << "Warning: " << warning << '\n';
+        }
+        {
+            PgConnection source{config.source};
+            describeColumns(plan, source);
+        }
+        planTimer.reset();
 
-        vector<Table> query_order = direct_descendants;
-        query_order.insert(query_order.end(), non_direct_descendants.begin(), non_direct_descendants.end());
-        vector<Table> insert_order = non_direct_descendants;
-        insert_order.insert(insert_order.end(), direct_descendants.begin(), direct_descendants.end());
-
-        fs::create_directory("query_order_results");
-
-        auto psqlGetRootRow = [&config, root_table, root_id]() {
-            std::ostringstream command;
-            const auto& source = config.source; // Access the database source from the config
-            std::string sslMode = source.sslEnabled ? "require" : "disable";
-
-            command << "PGPASSWORD=" + source.password + " psql " +
-            "-h " + source.host + " " +
-            "-p " + std::to_string(source.port) + " " +
-            "-d " + source.name + " " +
-            "-U " + source.username + " ";
-            if(sslMode == "require") {
-                command << "sslmode=require";
-            }
-            command << "<<EOF\n";
-            command << "\\copy (SELECT * FROM " << root_table << " WHERE id = '" << root_id << "') TO '" << fs::absolute(fs::path("query_order_results") / root_table).string() << "' WITH (DELIMITER '\x1F', HEADER);\n" << "EOF";
-            return command.str();
-        };
-
-        auto psqlSourceTransaction = [&](const std::function<void(std::ostringstream&)>& func) {
-            std::ostringstream command;
-            const auto& source = config.source; // Access the database source from the config
-            std::string sslMode = source.sslEnabled ? "require" : "disable";
-
-             command << "PGPASSWORD=" + source.password + " psql " +
-            "-h " + source.host + " " +
-            "-p " + std::to_string(source.port) + " " +
-            "-d " + source.name + " " +
-            "-U " + source.username + " " + 
-            "-v ON_ERROR_STOP=1";
-            command << " <<EOF\n";
-
-
-            command << "-- Step 1: Start a transaction\n";
-            command << "BEGIN;\n\n";
-
-            func(command);
-
-            command << "-- Step 5: Commit the transaction\n";
-            command << "COMMIT;\n";
-            command << "EOF";
-
-            return command.str();
-        };
-
-        unordered_set<string> loadedToTemp;
-
-        auto isDirectDescendent = [&](const string& table) {
-            return table_info[table].direct_descendant;
+        auto rootIdsOf = [&](const TablePlan& table) -> const vector<string>& {
+            static const vector<string> none;
+            auto ids = root_ids.find(table.name);
+            return ids == root_ids.end() ? none : ids->second;
         };
 
-        auto psqlCopyFrom = [&]() {
-            return psqlSourceTransaction([&](std::ostringstream& command) {           
-                for(auto table : query_order) {
-                    if(table.name == root_table) continue;
-                    command << "\\echo  Processing table: " << table.name << "\n";
-
-                    if(table.direct_descendant || (!table.direct_descendant && table.supporters.size() > 0)) {
-                        CopyFromSupporters supporters;
-                        for(auto supp : table.supporters) {
-                            string colName = fkey_map[supp.first][table.name][supp.second];
-                            string sWithRespectToD = inv_fkey_map[supp.first][table.name][colName];
-                            supporters.tableToCol[supp.first] = sWithRespectToD;
-                            supporters.tableToFilePath[supp.first] = fs::absolute(fs::path("query_order_results") / supp.first).string();
-                        }
-
-                        CopyFromDependent dependent;
-                        dependent.tableName = table.name;
-                        dependent.filePath = fs::absolute(fs::path("query_order_results") / table.name).string();
-                        std::ofstream outfile(dependent.filePath);
-                        outfile.close();
-                    
-                        for(const auto& [table, col] : supporters.tableToCol) {
-                            if(loadedToTemp.count(table)) continue;
-                            loadedToTemp.insert(table);
-                            command << "CREATE TEMP TABLE \"TEMP_" << table << "\" AS SELECT * FROM \"" << table << "\" WHERE 1=0;\n";
-
-                            command << "\\copy \"TEMP_" << table << "\" FROM '" << supporters.tableToFilePath[table] << "' WITH (DELIMITER '\x1F', HEADER);\n";
-                        }
-
-                        command << "\\copy (SELECT DISTINCT \"" << dependent.tableName<< "\".* FROM \"" << dependent.tableName << "\" "; 
-                        for(const auto& [sTable, sCol] : supporters.tableToCol) {
-                            if(!table_info[sTable].direct_descendant && table.direct_descendant) continue;
-                            string dCol = fkey_map[sTable][dependent.tableName][sCol];
-                            command << "INNER JOIN \"TEMP_" << sTable << "\" ON \"" << dependent.tableName << "\".\"" << dCol << "\" = \"TEMP_" << sTable << "\".\"" << sCol << "\" ";
-                        }
-
-                        command << ") TO '" << dependent.filePath << "' WITH (DELIMITER '\x1F', HEADER);\n\n" ;
+        std::ostringstream fullScriptOutFile;
+        fullScriptOutFile << "-- This script was generated by the program.\n";
+        fullScriptOutFile << "BEGIN ISOLATION LEVEL REPEATABLE READ;\n";
+        for(const auto& level : plan.extractLevels) {
+            for(const ExtractStep& step : level) {
+                const ComponentPlan& component = plan.components[step.component];
+                for(size_t index : component.members) {
+                    const TablePlan& table = plan.tables[index];
+                    if(step.descent) {
+                        fullScriptOutFile << "CREATE TEMP TABLE " << downName(table.name) << " AS " << descentQuery(table, rootIdsOf) << ";\n";
                     } else {
-                        CopyFromDependents dependents;
-                        for(auto dep : table.dependents) {
-                            string colName = inv_fkey_map[table.name][dep.first][dep.second];
-                            string dWithRespectToS = fkey_map[table.name][dep.first][colName];
-                            dependents.tableToCol[dep.first] = dWithRespectToS;
-                            dependents.tableToFilePath[dep.first] = fs::absolute(fs::path("query_order_results") / dep.first).string();
-                        }
-                        CopyFromSupporter supporter;
-                        supporter.tableName = table.name;
-                        supporter.filePath = fs::absolute(fs::path("query_order_results") / table.name).string();
-                        std::ofstream outfile(supporter.filePath);
-                        outfile.close();
-
-                        for(const auto& [table, col] : dependents.tableToCol) {
-                            if(loadedToTemp.count(table)) continue;
-                            loadedToTemp.insert(table);
-                            command << "CREATE TEMP TABLE \"TEMP_" << table << "\" AS SELECT * FROM \"" << table << "\" WHERE 1=0;\n";
-
-                            command << "\\copy \"TEMP_" << table << "\" FROM '" << dependents.tableToFilePath[table] << "' WITH (DELIMITER '\x1F', HEADER);\n";
-                        }
-                        command << "\\copy (SELECT DISTINCT \"" << supporter.tableName << "\".* FROM \"" << supporter.tableName << "\" ";
-                        for(const auto& [table, col] : dependents.tableToCol) {
-                            string sCol = inv_fkey_map[supporter.tableName][table][col];
-                            command << "LEFT JOIN \"TEMP_" << table << "\" ON \"" << supporter.tableName << "\".\"" << sCol << "\" = \"TEMP_" << table << "\".\"" << col << "\" ";
-                        }
-                        command << "WHERE ";
-                        int index = 0;
-                        for(const auto& [table, col] : dependents.tableToCol) {
-                            if(index++ != 0) command << " OR ";
-                            command << "\"TEMP_" << table << "\".\"" << col << "\" IS NOT NULL";
-                        }
-                        command << ") TO '" << supporter.filePath << "' WITH (DELIMITER '\x1F', HEADER);\n\n" ;
+                        fullScriptOutFile << "CREATE TEMP TABLE " << tempName(table.name) << " AS " << table.joinQuery << ";\n";
                     }
                 }
-            });
-        };
-
-        auto beforeCopyFromTime = std::chrono::steady_clock::now();
-        std::ofstream outfile(fs::absolute(fs::path("query_order_results") / root_table));
-        outfile.close();
-        string psqlGetRootRowCommand = psqlGetRootRow();
-        int command_res = system(psqlGetRootRowCommand.c_str());
-
-        auto psqlCopyFromCommand = psqlCopyFrom();
-        std::ofstream fullScriptOutFile("full_script.sql");
-        fullScriptOutFile << "-- This script was generated by the program.\n";
-        fullScriptOutFile << psqlGetRootRowCommand;
-        fullScriptOutFile << psqlCopyFromCommand;
-        fullScriptOutFile.close();
-        command_res = system(psqlCopyFromCommand.c_str());
-        assert(!command_res);
-
-        auto psqlCopyTo = [&config](string tableName, string filePath) {
-            // Start building the psql command
-            std::ostringstream command;
-            const auto& destination = config.destination; 
-
-            command << "PGPASSWORD=" + destination.password + " psql " +
-            "-h " + destination.host + " " +
-            "-p " + std::to_string(destination.port) + " " +
-            "-d " + destination.name + " " +
-            "-U " + destination.username + " ";
-            command << " <<EOF\n";
-
-            command << "-- Step 1: Start a transaction\n";
-            command << "BEGIN;\n\n";
-            command << "\\echo  Processing table: " << tableName << "\n";
-            command << "\\copy " << tableName << " FROM '" << filePath << "' WITH (DELIMITER '\x1F', HEADER);\n";
-            command << "COMMIT;\n";
-            command << "EOF";
+                const string& closure = step.descent ? component.descentClosure : component.closure;
+                if(!closure.empty()) {
+                    fullScriptOutFile << closure << "\n";
+                }
+            }
+        }
+        for(const auto& table : plan.tables) {
+            fullScriptOutFile << "COPY (" << table.fetchQuery << ") TO STDOUT (FORMAT binary);\n";
+        }
+        fullScriptOutFile << "COMMIT;\n";
+        const string full_script = fullScriptOutFile.str();
+        std::ofstream("full_script.sql") << full_script;
+
+        // Plan-only: show the orders and the planner's estimates for every
+        // extract query, and the FKs the source has no index for. No data moves.
+        if(plan_only) {
+            PgConnection source{config.source};
+            vector<TableEstimate> estimates = estimatePlan(source, plan, rootIdsOf);
+            std::printf("%-40s %5s %14s %14s %14s %12s\n", "table (load order)", "level", "est. rows", "table rows", "est. bytes", "cost");
+            double total_rows = 0, total_bytes = 0;
+            for(size_t index = 0; index < plan.tables.size(); ++index) {
+                const TablePlan& table = plan.tables[index];
+                const TableEstimate& estimate = estimates[index];
+                std::printf("%-40s %5zu %13.0f%s %14.0f %14.0f %12.1f\n", table.name.c_str(), plan.components[table.component].extractLevel,
+                    estimate.rows, estimate.lowerBound ? "+" : " ", estimate.tableRows, estimate.bytes, estimate.cost);
+                total_rows += estimate.rows;
+                total_bytes += estimate.bytes;
+            }
+            std::printf("%-40s %5s %13.0f  %14s %14.0f\n", "total", "", total_rows, "", total_bytes);
+            std::cout << "(+ marks a member of an FK cycle; its closure can only add rows)\n\n";
+
+            std::cout << "Insert order:\n";
+            for(size_t level = 0; level < plan.loadLevels.size(); ++level) {
+                std::cout << "  " << level << ":";
+                for(size_t c : plan.loadLevels[level]) {
+                    for(size_t index : plan.components[c].members) {
+                        std::cout << ' ' << plan.tables[index].name;
+                    }
+                }
+                std::cout << '\n';
+            }
 
-            return command.str();
-        };
+            vector<UnindexedForeignKey> unindexed = findUnindexedForeignKeys(source, graph, plan);
+            std::cout << '\n' << (unindexed.empty() ? "Every FK between planned tables is indexed on the source.\n" : "FK columns without an index on the source:\n");
+            for(const auto& fk : unindexed) {
+                std::cout << "  " << fk.table << " (" << valuesFromVector(fk.columns, ", ") << ") -> " << fk.foreignTable
+                          << (fk.used ? "   <- joined on by the traversal, expect a sequential scan" : "") << '\n';
+            }
+            std::cout << "Join SQL written to full_script.sql\n";
+            return 0;
+        }
 
-        for(auto table : insert_order) {
-            string psqlCopyToCommand = psqlCopyTo(table.name, fs::absolute(fs::path("query_order_results") / table.name).string());
-            int command_res = system(psqlCopyToCommand.c_str());
-            assert(!command_res);
+        // With a checkpoint, every fetched table is written to disk and the
+        // manifest tracks what has been fetched and loaded.
+        std::unique_ptr<Checkpoint> checkpoint;
+        if(!checkpoint_dir.empty()) {
+            // The script carries the plan and roots; the load options change
+            // what a loaded component means, so they count too.
+            string load_options;
+            if(remap) load_options += "\n-- remap";
+            if(single_transaction) load_options += "\n-- single-transaction";
+            if(replica_role) load_options += "\n-- replica";
+            if(rebuild_indexes) load_options += "\n-- rebuild-indexes";
+            checkpoint = std::make_unique<Checkpoint>(checkpoint_dir, planHash(full_script + load_options), plan, compress);
+            if(resume && !checkpoint->load()) {
+                std::cout << "No checkpoint for this plan in " << checkpoint_dir << ", starting over\n";
+            } else {
+                run_options.resume = resume;
+            }
         }
 
+        auto beforeCopyFromTime = std::chrono::steady_clock::now();
+        run_options.serverTimings = server_timings;
+        RunConnections connections{config, jobs};
+        executePlan(graph, plan, rootIdsOf, connections, metrics, run_options, checkpoint.get());
+
         std::chrono::time_point afterTime = std::chrono::steady_clock::now();
         std::chrono::duration<float> elapsedTime = afterTime - beforeTime;
         std::chrono::duration<float> elapsedTimeCopyFrom = afterTime - beforeCopyFromTime;
         std::cout << "Program ran in: " << elapsedTime.count() << '\n';
         std::cout << "CopyFromSource ran in: " << elapsedTimeCopyFrom.count() << '\n';
         std::cout << fs::current_path() << '\n';
-        //std::cout << "Cleaning query_order_results directory...\n";
-        //fs::remove_all("query_order_results");
-        conn.disconnect();
+        writeMetrics();
 
     } catch (const pgfe::Server_exception& e) {
         std::cout << e.error().detail() << '\n';
@@ -468,6 +333,8 @@ int main(int argc, char** argv)
         std::printf("Error %s is handled as expected.\n", e.error().sqlstate());
 } catch (const std::exception& e) {
     std::printf("Oops: %s\n", e.what());
+    // A failed run is the one worth looking at; keep what was measured.
+    try { writeMetrics(); } catch(const std::exception&) {}
     return 1;
 
     }
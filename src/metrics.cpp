@@ -0,0 +1,165 @@
+#include "metrics.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <stdexcept>
+
+namespace fs = std::filesystem;
+
+Metrics::Metrics() : origin(Clock::now()) {
+    threads.emplace(std::this_thread::get_id(), 0);
+}
+
+Metrics::Timer::Timer(Metrics& metrics, std::string phase, std::string table)
+    : metrics(metrics), start(Clock::now()) {
+    span.phase = std::move(phase);
+    span.table = std::move(table);
+}
+
+Metrics::Timer::~Timer() {
+    auto end = Clock::now();
+    span.startUs = std::chrono::duration_cast<std::chrono::microseconds>(start - metrics.origin).count();
+    span.durationUs = std::chrono::duration_cast<std::chrono::microseconds>(end - start).count();
+    metrics.record(std::move(span));
+}
+
+void Metrics::record(Span span) {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto [it, inserted] = threads.try_emplace(std::this_thread::get_id(), static_cast<uint32_t>(threads.size()));
+    span.thread = it->second;
+    spans.push_back(std::move(span));
+}
+
+namespace {
+
+std::string jsonString(const std::string& value) {
+    std::string out = "\"";
+    for(char c : value) {
+        switch(c) {
+            case '"': out += "\\\""; break;
+            case '\\': out += "\\\\"; break;
+            case '\n': out += "\\n"; break;
+            case '\t': out += "\\t"; break;
+            default:
+                if(static_cast<unsigned char>(c) < 0x20) {
+                    char escaped[8];
+                    std::snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+                    out += escaped;
+                } else {
+                    out += c;
+                }
+        }
+    }
+    return out + "\"";
+}
+
+std::string jsonNumber(double value) {
+    char buffer[32];
+    std::snprintf(buffer, sizeof(buffer), "%.3f", value);
+    return buffer;
+}
+
+struct Totals {
+    uint64_t count = 0;
+    int64_t durationUs = 0;
+    int64_t rows = -1;
+    int64_t bytes = -1;
+    double serverMs = -1;
+
+    void add(const Span& span) {
+        count++;
+        durationUs += span.durationUs;
+        if(span.rows >= 0) rows = std::max<int64_t>(rows, 0) + span.rows;
+        if(span.bytes >= 0) bytes = std::max<int64_t>(bytes, 0) + span.bytes;
+        if(span.serverMs >= 0) serverMs = std::max(serverMs, 0.0) + span.serverMs;
+    }
+
+    std::string json() const {
+        std::string out = "{\"count\": " + std::to_string(count) + ", \"ms\": " + jsonNumber(durationUs / 1000.0);
+        if(rows >= 0) out += ", \"rows\": " + std::to_string(rows);
+        if(bytes >= 0) out += ", \"bytes\": " + std::to_string(bytes);
+        if(serverMs >= 0) out += ", \"server_ms\": " + jsonNumber(serverMs);
+        return out + "}";
+    }
+};
+
+void writeFile(const std::string& filePath, const std::string& contents) {
+    if(fs::path(filePath).has_parent_path()) {
+        fs::create_directories(fs::path(filePath).parent_path());
+    }
+    std::ofstream ofs(filePath);
+    if(!ofs.good()) {
+        throw std::runtime_error("cannot write " + filePath);
+    }
+    ofs << contents;
+}
+
+} // namespace
+
+void Metrics::writeSummary(const std::string& filePath) const {
+    std::lock_guard<std::mutex> lock(mutex);
+    // Ordered maps keep the file stable between runs so two of them diff cleanly.
+    std::map<std::string, Totals> run;
+    std::map<std::string, std::map<std::string, Totals>> tables;
+    int64_t endUs = 0;
+    for(const Span& span : spans) {
+        (span.table.empty() ? run[span.phase] : tables[span.table][span.phase]).add(span);
+        endUs = std::max(endUs, span.startUs + span.durationUs);
+    }
+
+    std::string out = "{\n  \"total_ms\": " + jsonNumber(endUs / 1000.0) + ",\n  \"phases\": {";
+    bool first = true;
+    for(const auto& [phase, totals] : run) {
+        out += std::string(first ? "" : ",") + "\n    " + jsonString(phase) + ": " + totals.json();
+        first = false;
+    }
+    out += "\n  },\n  \"tables\": {";
+    first = true;
+    for(const auto& [table, phases] : tables) {
+        out += std::string(first ? "" : ",") + "\n    " + jsonString(table) + ": {";
+        bool firstPhase = true;
+        for(const auto& [phase, totals] : phases) {
+            out += std::string(firstPhase ? "" : ",") + "\n      " + jsonString(phase) + ": " + totals.json();
+            firstPhase = false;
+        }
+        out += "\n    }";
+        first = false;
+    }
+    out += "\n  }\n}\n";
+    writeFile(filePath, out);
+}
+
+void Metrics::writeTrace(const std::string& filePath) const {
+    std::lock_guard<std::mutex> lock(mutex);
+    std::string out = "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [";
+    for(uint32_t thread = 0; thread < threads.size(); ++thread) {
+        out += std::string(thread == 0 ? "" : ",") + "\n{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": " + std::to_string(thread)
+            + ", \"args\": {\"name\": " + jsonString(thread == 0 ? std::string("main") : "worker " + std::to_string(thread)) + "}}";
+    }
+    for(const Span& span : spans) {
+        std::string args = "\"table\": " + jsonString(span.table);
+        if(span.rows >= 0) args += ", \"rows\": " + std::to_string(span.rows);
+        if(span.bytes >= 0) args += ", \"bytes\": " + std::to_string(span.bytes);
+        if(span.serverMs >= 0) args += ", \"server_ms\": " + jsonNumber(span.serverMs);
+        out += ",\n{\"name\": " + jsonString(span.table.empty() ? span.phase : span.phase + " " + span.table)
+            + ", \"cat\": " + jsonString(span.phase)
+            + ", \"ph\": \"X\", \"pid\": 1, \"tid\": " + std::to_string(span.thread)
+            + ", \"ts\": " + std::to_string(span.startUs) + ", \"dur\": " + std::to_string(span.durationUs)
+            + ", \"args\": {" + args + "}}";
+    }
+    out += "\n]}\n";
+    writeFile(filePath, out);
+}
+
+ServerTiming explainAnalyze(PgConnection& conn, const std::string& sql) {
+    auto rows = conn.query("EXPLAIN (ANALYZE, TIMING OFF, FORMAT JSON) " + sql);
+    ServerTiming timing;
+    if(rows.empty() || rows[0].empty()) return timing;
+    timing.executionMs = explainValue(rows[0][0], "Execution Time", -1);
+    timing.rows = static_cast<uint64_t>(explainValue(rows[0][0], "Actual Rows", 0));
+    return timing;
+}
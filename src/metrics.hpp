@@ -0,0 +1,78 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "pg.hpp"
+
+// One timed step of the run: a phase for one table, or a run-wide phase when
+// table is empty. Counters the step could not measure stay negative.
+struct Span {
+    std::string phase;          // discovery, descent, extract, closure, temp-load, fetch, load, ...
+    std::string table;
+    int64_t startUs = 0;        // since the start of the run
+    int64_t durationUs = 0;
+    uint32_t thread = 0;        // small dense id, one per OS thread that recorded spans
+    int64_t rows = -1;
+    int64_t bytes = -1;
+    double serverMs = -1;       // execution time reported by the server
+};
+
+// Collects spans from any thread. Recording is cheap, so it is always on;
+// the files are only written when asked for.
+class Metrics {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    // Times one step from construction to destruction and records it then,
+    // with whatever counters were set in between.
+    class Timer {
+    public:
+        Timer(Metrics& metrics, std::string phase, std::string table);
+        ~Timer();
+        Timer(const Timer&) = delete;
+        Timer& operator=(const Timer&) = delete;
+
+        void rows(uint64_t rows) { span.rows = static_cast<int64_t>(rows); }
+        void bytes(uint64_t bytes) { span.bytes = static_cast<int64_t>(bytes); }
+        void serverMs(double ms) { span.serverMs = ms; }
+
+    private:
+        Metrics& metrics;
+        Span span;
+        Clock::time_point start;
+    };
+
+    // The constructing thread is track 0.
+    Metrics();
+
+    Timer time(std::string phase, std::string table = "") { return Timer(*this, std::move(phase), std::move(table)); }
+    void record(Span span);
+
+    // Per-table totals for each phase, plus run-wide phases, as JSON.
+    void writeSummary(const std::string& filePath) const;
+    // Chrome trace-event format, one complete ("X") event per span and one
+    // track per thread. Opens in chrome://tracing and Perfetto.
+    void writeTrace(const std::string& filePath) const;
+
+private:
+    Clock::time_point origin;
+    mutable std::mutex mutex;
+    std::vector<Span> spans;
+    std::unordered_map<std::thread::id, uint32_t> threads;
+};
+
+// What the server reported for a statement run under EXPLAIN ANALYZE.
+struct ServerTiming {
+    double executionMs = -1;
+    uint64_t rows = 0;
+};
+
+// Runs sql under EXPLAIN (ANALYZE, TIMING OFF, FORMAT JSON). The statement is
+// really executed, so this works for CREATE TABLE ... AS as well as SELECT.
+ServerTiming explainAnalyze(PgConnection& conn, const std::string& sql);
@@ -0,0 +1,202 @@
+#include "pg.hpp"
+
+#include <cstdlib>
+#include <string>
+
+std::string quoteIdentifier(const std::string& name) {
+    std::string out = "\"";
+    for(char c : name) {
+        if(c == '"') out += '"';
+        out += c;
+    }
+    out += '"';
+    return out;
+}
+
+std::string quoteLiteral(const std::string& value) {
+    std::string out = "'";
+    for(char c : value) {
+        if(c == '\'') out += '\'';
+        out += c;
+    }
+    out += '\'';
+    return out;
+}
+
+std::string quoteArrayLiteral(const std::vector<std::string>& values) {
+    std::string array = "{";
+    for(size_t i = 0; i < values.size(); ++i) {
+        if(i != 0) array += ',';
+        array += '"';
+        for(char c : values[i]) {
+            if(c == '"' || c == '\\') array += '\\';
+            array += c;
+        }
+        array += '"';
+    }
+    array += '}';
+    return quoteLiteral(array);
+}
+
+double explainValue(const std::string& planJson, const std::string& key, double fallback) {
+    auto at = planJson.find("\"" + key + "\": ");
+    if(at == std::string::npos) return fallback;
+    return std::strtod(planJson.c_str() + at + key.size() + 4, nullptr);
+}
+
+PgConnection::PgConnection(const DatabaseInfo& info) {
+    std::string port = std::to_string(info.port);
+    const char* keywords[] = { "host", "port", "dbname", "user", "password", "sslmode", nullptr };
+    const char* values[] = {
+        info.host.c_str(),
+        port.c_str(),
+        info.name.c_str(),
+        info.username.c_str(),
+        info.password.c_str(),
+        info.sslEnabled ? "require" : "disable",
+        nullptr
+    };
+    conn = PQconnectdbParams(keywords, values, 0);
+    if(PQstatus(conn) != CONNECTION_OK) {
+        std::string message = PQerrorMessage(conn);
+        PQfinish(conn);
+        conn = nullptr;
+        throw PgError("connection to " + info.host + ":" + port + "/" + info.name + " failed: " + message);
+    }
+}
+
+PgConnection::~PgConnection() {
+    if(conn) PQfinish(conn);
+}
+
+void PgConnection::checkResult(PGresult* res, ExecStatusType expected, const std::string& sql) {
+    if(PQresultStatus(res) != expected) {
+        std::string message = PQresultErrorMessage(res);
+        PQclear(res);
+        throw PgError(message + "while running: " + sql.substr(0, 200));
+    }
+}
+
+void PgConnection::recordRowCount(PGresult* res) {
+    const char* tuples = PQcmdTuples(res);
+    lastRows = *tuples ? std::strtoull(tuples, nullptr, 10) : 0;
+}
+
+void PgConnection::execute(const std::string& sql) {
+    if(!PQsendQuery(conn, sql.c_str())) {
+        throw PgError(std::string(PQerrorMessage(conn)) + "while running: " + sql.substr(0, 200));
+    }
+    // A multi-statement string yields one result per statement, report the first failure.
+    std::string error;
+    while(PGresult* res = PQgetResult(conn)) {
+        ExecStatusType status = PQresultStatus(res);
+        if(error.empty() && status != PGRES_COMMAND_OK && status != PGRES_TUPLES_OK) {
+            error = PQresultErrorMessage(res);
+        }
+        recordRowCount(res);
+        PQclear(res);
+    }
+    if(!error.empty()) {
+        throw PgError(error + "while running: " + sql.substr(0, 200));
+    }
+}
+
+std::vector<std::vector<std::string>> PgConnection::query(const std::string& sql) {
+    PGresult* res = PQexec(conn, sql.c_str());
+    checkResult(res, PGRES_TUPLES_OK, sql);
+    std::vector<std::vector<std::string>> rows(PQntuples(res));
+    int columns = PQnfields(res);
+    for(size_t i = 0; i < rows.size(); ++i) {
+        rows[i].reserve(columns);
+        for(int j = 0; j < columns; ++j) {
+            rows[i].emplace_back(PQgetvalue(res, i, j), PQgetlength(res, i, j));
+        }
+    }
+    PQclear(res);
+    return rows;
+}
+
+size_t PgConnection::copyOut(const std::string& sql, const std::function<void(const char*, size_t)>& sink) {
+    PGresult* res = PQexec(conn, sql.c_str());
+    checkResult(res, PGRES_COPY_OUT, sql);
+    PQclear(res);
+
+    size_t bytes = 0;
+    char* buffer = nullptr;
+    int length;
+    while((length = PQgetCopyData(conn, &buffer, 0)) > 0) {
+        try {
+            sink(buffer, length);
+        } catch(...) {
+            PQfreemem(buffer);
+            // Drain the rest so the connection is usable again, then rethrow.
+            while((length = PQgetCopyData(conn, &buffer, 0)) > 0) PQfreemem(buffer);
+            while(PGresult* r = PQgetResult(conn)) PQclear(r);
+            throw;
+        }
+        bytes += length;
+        PQfreemem(buffer);
+    }
+    if(length == -2) {
+        throw PgError(std::string(PQerrorMessage(conn)) + "while running: " + sql.substr(0, 200));
+    }
+    res = PQgetResult(conn);
+    checkResult(res, PGRES_COMMAND_OK, sql);
+    recordRowCount(res);
+    PQclear(res);
+    while(PGresult* r = PQgetResult(conn)) PQclear(r);
+    return bytes;
+}
+
+void PgConnection::beginCopyIn(const std::string& sql) {
+    PGresult* res = PQexec(conn, sql.c_str());
+    checkResult(res, PGRES_COPY_IN, sql);
+    PQclear(res);
+    copyingIn = true;
+}
+
+void PgConnection::putCopyData(const char* data, size_t size) {
+    if(PQputCopyData(conn, data, static_cast<int>(size)) != 1) {
+        throw PgError(std::string("COPY FROM STDIN failed: ") + PQerrorMessage(conn));
+    }
+}
+
+void PgConnection::endCopyIn() {
+    copyingIn = false;
+    if(PQputCopyEnd(conn, nullptr) != 1) {
+        throw PgError(std::string("COPY FROM STDIN failed: ") + PQerrorMessage(conn));
+    }
+    std::string error;
+    while(PGresult* res = PQgetResult(conn)) {
+        if(error.empty() && PQresultStatus(res) != PGRES_COMMAND_OK) {
+            error = PQresultErrorMessage(res);
+        }
+        recordRowCount(res);
+        PQclear(res);
+    }
+    if(!error.empty()) {
+        throw PgError("COPY FROM STDIN failed: " + error);
+    }
+}
+
+void PgConnection::abortCopyIn(const std::string& reason) {
+    if(!copyingIn) return;
+    copyingIn = false;
+    PQputCopyEnd(conn, reason.c_str());
+    while(PGresult* res = PQgetResult(conn)) PQclear(res);
+}
+
+void PgConnection::recover() {
+    abortCopyIn("run aborted");
+    if(PQstatus(conn) != CONNECTION_OK) {
+        PQreset(conn);
+        if(PQstatus(conn) != CONNECTION_OK) {
+            throw PgError(std::string("reconnect failed: ") + PQerrorMessage(conn));
+        }
+        return;
+    }
+    PGTransactionStatusType status = PQtransactionStatus(conn);
+    if(status == PQTRANS_INTRANS || status == PQTRANS_INERROR) {
+        execute("ROLLBACK;");
+    }
+}
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <libpq-fe.h>
+
+#include "config.hpp"
+
+struct PgError : std::runtime_error {
+    using std::runtime_error::runtime_error;
+};
+
+std::string quoteIdentifier(const std::string& name);
+std::string quoteLiteral(const std::string& value);
+// '{"a","b"}' - an untyped array literal the server coerces to the column's array type.
+std::string quoteArrayLiteral(const std::vector<std::string>& values);
+
+// First value of key in EXPLAIN (FORMAT JSON) output, or fallback. The top
+// plan node is printed first, so that is the one found for per-node keys.
+double explainValue(const std::string& planJson, const std::string& key, double fallback);
+
+// Thin RAII wrapper over a libpq connection. pgfe is row oriented; the copy
+// paths need raw COPY buffers, so they go through libpq directly.
+class PgConnection {
+public:
+    explicit PgConnection(const DatabaseInfo& info);
+    ~PgConnection();
+
+    PgConnection(const PgConnection&) = delete;
+    PgConnection& operator=(const PgConnection&) = delete;
+
+    // Runs one or more statements that return no rows of interest.
+    void execute(const std::string& sql);
+
+    // Runs a query and returns every row as text. NULLs come back empty.
+    std::vector<std::vector<std::string>> query(const std::string& sql);
+
+    // Runs a COPY ... TO STDOUT and hands each buffer to sink as it arrives.
+    // Returns the number of bytes received.
+    size_t copyOut(const std::string& sql, const std::function<void(const char*, size_t)>& sink);
+
+    // COPY ... FROM STDIN in three steps so callers can feed it from anywhere.
+    void beginCopyIn(const std::string& sql);
+    void putCopyData(const char* data, size_t size);
+    void endCopyIn();
+    // Aborts an in-progress COPY FROM STDIN, the server rolls the statement back.
+    void abortCopyIn(const std::string& reason);
+
+    // Brings a session that outlives a failed run back to idle: reconnects a
+    // broken connection and rolls back an open transaction.
+    void recover();
+
+    // Rows reported by the last command's completion tag (SELECT n, COPY n, ...).
+    uint64_t lastRowCount() const { return lastRows; }
+
+    PGconn* native() const { return conn; }
+
+private:
+    PGconn* conn = nullptr;
+    bool copyingIn = false;
+    uint64_t lastRows = 0;
+
+    void recordRowCount(PGresult* res);
+
+    void checkResult(PGresult* res, ExecStatusType expected, const std::string& sql);
+};
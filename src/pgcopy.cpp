@@ -0,0 +1,93 @@
+#include "pgcopy.hpp"
+
+#include <cstring>
+#include <stdexcept>
+
+namespace {
+
+const char SIGNATURE[COPY_SIGNATURE_SIZE] = { 'P', 'G', 'C', 'O', 'P', 'Y', '\n', '\377', '\r', '\n', '\0' };
+constexpr size_t FIXED_HEADER_SIZE = COPY_SIGNATURE_SIZE + 8;   // signature, flags, extension length
+
+} // namespace
+
+int16_t readInt16(const char* at) {
+    const auto* bytes = reinterpret_cast<const unsigned char*>(at);
+    return static_cast<int16_t>((bytes[0] << 8) | bytes[1]);
+}
+
+int32_t readInt32(const char* at) {
+    const auto* bytes = reinterpret_cast<const unsigned char*>(at);
+    return static_cast<int32_t>((uint32_t(bytes[0]) << 24) | (uint32_t(bytes[1]) << 16) | (uint32_t(bytes[2]) << 8) | bytes[3]);
+}
+
+void appendInt16(std::string& out, int16_t value) {
+    out += static_cast<char>((value >> 8) & 0xFF);
+    out += static_cast<char>(value & 0xFF);
+}
+
+void appendInt32(std::string& out, int32_t value) {
+    for(int shift = 24; shift >= 0; shift -= 8) {
+        out += static_cast<char>((value >> shift) & 0xFF);
+    }
+}
+
+size_t copyHeaderSize(const char* data, size_t size) {
+    if(size < FIXED_HEADER_SIZE) return 0;
+    if(std::memcmp(data, SIGNATURE, COPY_SIGNATURE_SIZE) != 0) {
+        throw std::runtime_error("not a binary COPY stream");
+    }
+    size_t total = FIXED_HEADER_SIZE + static_cast<uint32_t>(readInt32(data + COPY_SIGNATURE_SIZE + 4));
+    return total <= size ? total : 0;
+}
+
+std::string copyHeaderExtension(const char* data, size_t size) {
+    size_t header = copyHeaderSize(data, size);
+    if(header == 0) return "";
+    return std::string(data + FIXED_HEADER_SIZE, header - FIXED_HEADER_SIZE);
+}
+
+std::string copyHeader(const std::string& extension) {
+    std::string header(SIGNATURE, COPY_SIGNATURE_SIZE);
+    appendInt32(header, 0);
+    appendInt32(header, static_cast<int32_t>(extension.size()));
+    return header + extension;
+}
+
+size_t copyTupleSize(const char* data, size_t size) {
+    if(size < 2) return 0;
+    int16_t fields = readInt16(data);
+    if(fields == -1) return COPY_TRAILER_SIZE;
+    size_t at = 2;
+    for(int16_t i = 0; i < fields; ++i) {
+        if(size - at < 4) return 0;
+        int32_t length = readInt32(data + at);
+        at += 4;
+        if(length > 0) {
+            if(size - at < static_cast<size_t>(length)) return 0;
+            at += length;
+        }
+    }
+    return at;
+}
+
+void forEachTuple(const RowSet& rows, const std::function<void(const char*, size_t)>& fn) {
+    bool first = true, ended = false;
+    rows.forEachBlock([&](const char* block, size_t size) {
+        size_t at = 0;
+        if(first) {
+            at = copyHeaderSize(block, size);
+            if(at == 0) throw std::runtime_error("binary COPY header is incomplete");
+            first = false;
+        }
+        while(at < size && !ended) {
+            size_t tuple = copyTupleSize(block + at, size - at);
+            if(tuple == 0) throw std::runtime_error("binary COPY tuple spans blocks");
+            if(isCopyTrailer(block + at)) {
+                ended = true;
+            } else {
+                fn(block + at, tuple);
+            }
+            at += tuple;
+        }
+    });
+}
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+
+#include "rowset.hpp"
+
+// PostgreSQL's binary COPY format: an 11-byte signature, a flags word and a
+// header extension, then per tuple a field count and length-prefixed fields
+// (-1 for NULL), closed by a field count of -1. Integers are big-endian.
+// Readers skip the extension, so exscribo keeps file metadata there.
+
+constexpr size_t COPY_SIGNATURE_SIZE = 11;
+constexpr size_t COPY_TRAILER_SIZE = 2;
+
+int16_t readInt16(const char* at);
+int32_t readInt32(const char* at);
+void appendInt16(std::string& out, int16_t value);
+void appendInt32(std::string& out, int32_t value);
+
+// Size of the header at the start of data, 0 when data does not hold all of it.
+// Throws when data does not start with the binary COPY signature.
+size_t copyHeaderSize(const char* data, size_t size);
+// The header's extension area.
+std::string copyHeaderExtension(const char* data, size_t size);
+// A header carrying extension in its extension area.
+std::string copyHeader(const std::string& extension);
+
+// Size of the tuple at data, or COPY_TRAILER_SIZE for the trailer. 0 when data
+// ends before the tuple does.
+size_t copyTupleSize(const char* data, size_t size);
+inline bool isCopyTrailer(const char* data) { return readInt16(data) == -1; }
+
+// Calls fn(tuple, size) for every tuple of the binary COPY stream in rows.
+// A row set never splits a chunk libpq handed over, and libpq hands over one
+// tuple per message, so every block holds whole tuples; the first block
+// starts with the header.
+void forEachTuple(const RowSet& rows, const std::function<void(const char*, size_t)>& fn);
@@ -0,0 +1,115 @@
+#include "pipeline.hpp"
+
+#include <algorithm>
+#include <thread>
+
+LoadScheduler::LoadScheduler(const Plan& plan, MemoryBudget* budget)
+    : plan(plan), budget(budget), dependents(plan.components.size()), waitingMembers(plan.components.size()),
+      waitingSupporters(plan.components.size()), done(plan.components.size(), false), remaining(plan.components.size()) {
+    for(size_t c = 0; c < plan.components.size(); ++c) {
+        waitingMembers[c] = plan.components[c].members.size();
+        waitingSupporters[c] = plan.components[c].supporters.size();
+        for(size_t supporter : plan.components[c].supporters) {
+            dependents[supporter].push_back(c);
+        }
+    }
+}
+
+void LoadScheduler::skip(size_t component) {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if(done[component]) return;
+        // Its rows are never loaded, so they no longer hold anything back.
+        waitingMembers[component] = SIZE_MAX;
+        finish(component);
+    }
+    notify();
+}
+
+void LoadScheduler::fetched(size_t table) {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        size_t component = plan.tables[table].component;
+        if(done[component]) return;
+        waitingMembers[component]--;
+        check(component);
+    }
+    notify();
+}
+
+void LoadScheduler::abort() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopped = true;
+    }
+    notify();
+}
+
+bool LoadScheduler::failed() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return stopped;
+}
+
+bool LoadScheduler::draining() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return !stopped && (!ready.empty() || running > 0);
+}
+
+void LoadScheduler::check(size_t component) {
+    if(!done[component] && waitingMembers[component] == 0 && waitingSupporters[component] == 0) {
+        ready.push_back(component);
+    }
+}
+
+void LoadScheduler::finish(size_t component) {
+    done[component] = true;
+    remaining--;
+    for(size_t dependent : dependents[component]) {
+        waitingSupporters[dependent]--;
+        check(dependent);
+    }
+}
+
+void LoadScheduler::notify() {
+    changed.notify_all();
+    if(budget) budget->wake();
+}
+
+void LoadScheduler::run(ConnectionPool& pool, size_t workers, const std::function<void(size_t, PgConnection&)>& load) {
+    auto work = [&](PgConnection& conn) {
+        std::unique_lock<std::mutex> lock(mutex);
+        while(true) {
+            changed.wait(lock, [&]() { return stopped || remaining == 0 || !ready.empty(); });
+            if(stopped || ready.empty()) break;
+            size_t component = ready.front();
+            ready.erase(ready.begin());
+            running++;
+            lock.unlock();
+            try {
+                load(component, conn);
+                lock.lock();
+                running--;
+                finish(component);
+            } catch(...) {
+                lock.lock();
+                running--;
+                if(!error) error = std::current_exception();
+                stopped = true;
+            }
+            lock.unlock();
+            notify();
+            lock.lock();
+        }
+    };
+
+    workers = std::max<size_t>(1, std::min(workers, pool.size()));
+    std::vector<std::thread> threads;
+    for(size_t w = 1; w < workers; ++w) {
+        threads.emplace_back([&, w]() { work(pool.at(w)); });
+    }
+    work(pool.at(0));
+    for(auto& thread : threads) thread.join();
+
+    std::lock_guard<std::mutex> lock(mutex);
+    if(error) std::rethrow_exception(error);
+}
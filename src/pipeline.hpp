@@ -0,0 +1,61 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <vector>
+
+#include "plan.hpp"
+#include "pool.hpp"
+#include "rowset.hpp"
+
+// Loads components while extraction is still running. A component is ready
+// once every member's rows are fetched and every component it references has
+// loaded; ready components go to the next free loader connection. Safe to
+// feed from several extraction workers.
+class LoadScheduler {
+public:
+    // budget, when given, is woken whenever loads may start or finish.
+    LoadScheduler(const Plan& plan, MemoryBudget* budget = nullptr);
+
+    // The component is already in the destination (a resumed run).
+    void skip(size_t component);
+    // A table's rows are complete and may be loaded.
+    void fetched(size_t table);
+    // Stops handing out loads; run() returns once the running ones finish.
+    void abort();
+
+    // A load failed or abort() was called.
+    bool failed() const;
+    // A load is ready or running, so row memory is about to be released.
+    bool draining() const;
+
+    // Calls load(component, connection) for every component as it becomes
+    // ready, on at most `workers` connections of pool, and returns when all
+    // are loaded. The first exception thrown by a load stops the others and
+    // is rethrown after they have finished.
+    void run(ConnectionPool& pool, size_t workers, const std::function<void(size_t, PgConnection&)>& load);
+
+private:
+    const Plan& plan;
+    MemoryBudget* budget;
+    std::vector<std::vector<size_t>> dependents;    // components referencing each component
+    std::vector<size_t> waitingMembers;             // members not fetched yet
+    std::vector<size_t> waitingSupporters;          // supporters not loaded yet
+    std::vector<bool> done;
+    std::vector<size_t> ready;
+    size_t running = 0;
+    size_t remaining;
+    bool stopped = false;
+    std::exception_ptr error;
+    mutable std::mutex mutex;
+    std::condition_variable changed;
+
+    // With the lock held: queues the component if nothing holds it back.
+    void check(size_t component);
+    // With the lock held: the component is in, unblocking its dependents.
+    void finish(size_t component);
+    void notify();
+};
@@ -0,0 +1,578 @@
+#include "plan.hpp"
+
+#include <algorithm>
+#include <functional>
+#include <stdexcept>
+#include <tuple>
+#include <unordered_map>
+
+#include "pg.hpp"
+
+std::string tempName(const std::string& table) {
+    return quoteIdentifier("TEMP_" + table);
+}
+
+std::string downName(const std::string& table) {
+    return quoteIdentifier("DOWN_" + table);
+}
+
+namespace {
+
+std::string qualified(const std::string& table, const std::string& column) {
+    return quoteIdentifier(table) + "." + quoteIdentifier(column);
+}
+
+// "<prefix><table>", quoted: DOWN_ and TEMP_ key tables and the closure's DELTA_/NEXT_ scratch tables.
+std::string keyTable(const std::string& prefix, const std::string& table) {
+    return quoteIdentifier(prefix + table);
+}
+
+// (T.c1 = <prefix>S.f1 AND T.c2 = <prefix>S.f2) for one constraint, T referencing S.
+std::string matchConstraint(const SchemaGraph& graph, const Constraint& c, const std::string& prefix) {
+    const std::string& table = graph.tableName(c.table);
+    const std::string& foreignTable = graph.tableName(c.foreignTable);
+    auto columns = graph.columnsOf(c);
+    auto foreignColumns = graph.foreignColumnsOf(c);
+    std::string match = "(";
+    for(size_t i = 0; i < columns.size(); ++i) {
+        if(i != 0) match += " AND ";
+        match += qualified(table, graph.columnName(columns[i])) + " = " + keyTable(prefix, foreignTable) + "." + quoteIdentifier(graph.columnName(foreignColumns[i]));
+    }
+    return match + ")";
+}
+
+// Same as matchConstraint but with the referencing side read from its key table.
+std::string matchConstraintFromDependent(const SchemaGraph& graph, const Constraint& c, const std::string& prefix) {
+    const std::string& table = graph.tableName(c.table);
+    const std::string& foreignTable = graph.tableName(c.foreignTable);
+    auto columns = graph.columnsOf(c);
+    auto foreignColumns = graph.foreignColumnsOf(c);
+    std::string match = "(";
+    for(size_t i = 0; i < columns.size(); ++i) {
+        if(i != 0) match += " AND ";
+        match += keyTable(prefix, table) + "." + quoteIdentifier(graph.columnName(columns[i])) + " = " + qualified(foreignTable, graph.columnName(foreignColumns[i]));
+    }
+    return match + ")";
+}
+
+// EXISTS over one neighbour's key table; any of the constraints to it may match.
+std::string existsIn(const std::string& keyTableName, const std::vector<std::string>& matches) {
+    std::string exists = "EXISTS (SELECT 1 FROM " + keyTableName + " WHERE ";
+    for(size_t i = 0; i < matches.size(); ++i) {
+        if(i != 0) exists += " OR ";
+        exists += matches[i];
+    }
+    return exists + ")";
+}
+
+// " WHERE c1 <op> c2 ...", or " WHERE false" when there is nothing to match.
+// A predicate, when given, has to hold as well.
+std::string whereClause(const std::vector<std::string>& conditions, const std::string& op, const std::string& predicate = "") {
+    if(conditions.empty()) return " WHERE false";
+    std::string where;
+    for(size_t i = 0; i < conditions.size(); ++i) {
+        where += (i == 0 ? "" : " " + op + " ") + conditions[i];
+    }
+    return predicate.empty() ? " WHERE " + where : " WHERE (" + where + ") AND (" + predicate + ")";
+}
+
+// Narrows the rows that pass predicate and reach across one edge by
+// condition: at most edge.limit per referenced row, ranked by primary key
+// among exactly those rows, and a random share of them. The result implies
+// both condition and predicate, so each referenced row keeps up to
+// edge.limit rows that are actually copied.
+std::string capEdge(const SchemaGraph& graph, const TablePlan& tp, const std::vector<ConstraintId>& constraints, const std::string& condition, const EdgeConfig& edge, const std::string& predicate) {
+    const std::string qualifying = predicate.empty() ? condition : "(" + condition + " AND " + predicate + ")";
+    std::string capped = qualifying;
+    if(edge.limit > 0) {
+        if(tp.primaryKey.empty()) {
+            throw std::runtime_error("Table " + tp.name + " has an edge limit but no primary key to rank rows by");
+        }
+        std::string pkQualified, pkBare, partition;
+        for(size_t i = 0; i < tp.primaryKey.size(); ++i) {
+            if(i != 0) { pkQualified += ", "; pkBare += ", "; }
+            pkQualified += qualified(tp.name, tp.primaryKey[i]);
+            pkBare += quoteIdentifier(tp.primaryKey[i]);
+        }
+        for(ConstraintId id : constraints) {
+            for(ColumnId column : graph.columnsOf(graph.constraint(id))) {
+                partition += (partition.empty() ? "" : ", ") + qualified(tp.name, graph.columnName(column));
+            }
+        }
+        capped = "(" + pkQualified + ") IN (SELECT " + pkBare + " FROM (SELECT " + pkQualified
+            + ", row_number() OVER (PARTITION BY " + partition + " ORDER BY " + pkQualified + ") AS exscribo_rank FROM "
+            + quoteIdentifier(tp.name) + " WHERE " + qualifying
+            + ") ranked WHERE exscribo_rank <= " + std::to_string(edge.limit) + ")";
+    }
+    if(edge.samplePercent < 100) {
+        capped = "(" + capped + " AND random() < " + std::to_string(std::max(0.0, edge.samplePercent) / 100) + ")";
+    }
+    return capped;
+}
+
+// Group a table's constraints by neighbour, keeping the order they were first seen.
+std::vector<std::pair<TableId, std::vector<ConstraintId>>> groupByNeighbour(
+    const SchemaGraph& graph,
+    std::span<const ConstraintId> edges,
+    bool neighbourIsSupporter,
+    const std::function<bool(TableId)>& keep
+) {
+    std::vector<std::pair<TableId, std::vector<ConstraintId>>> groups;
+    for(ConstraintId id : edges) {
+        const Constraint& c = graph.constraint(id);
+        TableId neighbour = neighbourIsSupporter ? c.foreignTable : c.table;
+        if(!keep(neighbour)) continue;
+        auto it = std::find_if(groups.begin(), groups.end(), [&](const auto& g) { return g.first == neighbour; });
+        if(it == groups.end()) {
+            groups.push_back({neighbour, {}});
+            it = groups.end() - 1;
+        }
+        it->second.push_back(id);
+    }
+    return groups;
+}
+
+// Turns the condition for member m's rows that reach new rows of a neighbour
+// into the condition for the rows it gains through them.
+using Narrow = std::function<std::string(size_t m, TableId neighbour, const std::vector<ConstraintId>& constraints, const std::string& condition)>;
+
+// Semi-naive fixpoint over a cycle's <prefix> key tables, run as one DO block
+// so the whole closure is a single round trip. Each round only joins against
+// the rows the previous round added (DELTA_<table>), and stops once a round
+// adds none. Going down, members gain the rows that reference new rows,
+// narrowed by narrow; going up, they gain the rows new rows reference.
+std::string fixpoint(const SchemaGraph& graph, const std::vector<TableId>& members, const std::vector<std::string>& keyLists, const std::string& prefix, bool down, const Narrow& narrow = {}) {
+    auto isMember = [&](TableId table) {
+        return std::find(members.begin(), members.end(), table) != members.end();
+    };
+
+    std::string sql = "DO $closure$\nDECLARE\n    added bigint;\n    total bigint;\nBEGIN\n";
+    for(TableId member : members) {
+        const std::string& name = graph.tableName(member);
+        sql += "    CREATE TEMP TABLE " + keyTable("DELTA_", name) + " AS SELECT * FROM " + keyTable(prefix, name) + ";\n";
+        sql += "    CREATE TEMP TABLE " + keyTable("NEXT_", name) + " AS SELECT * FROM " + keyTable(prefix, name) + " WHERE false;\n";
+    }
+    sql += "    LOOP\n        total := 0;\n";
+    for(size_t m = 0; m < members.size(); ++m) {
+        const std::string& name = graph.tableName(members[m]);
+        std::vector<std::string> conditions;
+        auto groups = down
+            ? groupByNeighbour(graph, graph.supporterEdges(members[m]), true, isMember)
+            : groupByNeighbour(graph, graph.dependentEdges(members[m]), false, isMember);
+        for(const auto& [neighbour, constraints] : groups) {
+            std::vector<std::string> matches;
+            for(ConstraintId id : constraints) {
+                matches.push_back(down
+                    ? matchConstraint(graph, graph.constraint(id), "DELTA_")
+                    : matchConstraintFromDependent(graph, graph.constraint(id), "DELTA_"));
+            }
+            std::string condition = existsIn(keyTable("DELTA_", graph.tableName(neighbour)), matches);
+            conditions.push_back(narrow ? narrow(m, neighbour, constraints, condition) : condition);
+        }
+        sql += "        TRUNCATE " + keyTable("NEXT_", name) + ";\n";
+        sql += "        INSERT INTO " + keyTable("NEXT_", name) + " SELECT " + keyLists[m] + " FROM " + quoteIdentifier(name)
+            + whereClause(conditions, "OR") + " EXCEPT SELECT * FROM " + keyTable(prefix, name) + ";\n";
+    }
+    for(TableId member : members) {
+        const std::string& name = graph.tableName(member);
+        sql += "        INSERT INTO " + keyTable(prefix, name) + " SELECT * FROM " + keyTable("NEXT_", name) + ";\n";
+        sql += "        GET DIAGNOSTICS added = ROW_COUNT;\n";
+        sql += "        total := total + added;\n";
+        sql += "        TRUNCATE " + keyTable("DELTA_", name) + ";\n";
+        sql += "        INSERT INTO " + keyTable("DELTA_", name) + " SELECT * FROM " + keyTable("NEXT_", name) + ";\n";
+    }
+    sql += "        EXIT WHEN total = 0;\n    END LOOP;\n";
+    for(TableId member : members) {
+        const std::string& name = graph.tableName(member);
+        sql += "    DROP TABLE " + keyTable("DELTA_", name) + ", " + keyTable("NEXT_", name) + ";\n";
+    }
+    return sql + "END\n$closure$;";
+}
+
+} // namespace
+
+Plan buildPlan(const SchemaGraph& graph, const std::vector<TableId>& roots, const TableRules& rules) {
+    static const TableConfig NO_RULE;
+    auto ruleOf = [&](const std::string& table) -> const TableConfig& {
+        auto rule = rules.find(table);
+        return rule == rules.end() ? NO_RULE : rule->second;
+    };
+    // Rules must name tables and edges of the schema. Whether they apply
+    // depends on the roots, so that is only checked once the plan stands.
+    std::vector<bool> skipped(graph.tableCount(), false);
+    for(const auto& [name, rule] : rules) {
+        auto table = graph.findTable(name);
+        if(!table) {
+            throw std::runtime_error("config has rules for table " + name + ", which has no primary or foreign keys in the public schema");
+        }
+        if(rule.skip) skipped[*table] = true;
+        for(const auto& edge : rule.edges) {
+            auto supporter = graph.findTable(edge.first);
+            auto supporterEdges = graph.supporterEdges(*table);
+            bool references = supporter && std::any_of(supporterEdges.begin(), supporterEdges.end(), [&](ConstraintId id) {
+                return graph.constraint(id).foreignTable == *supporter;
+            });
+            if(!references) {
+                throw std::runtime_error("config caps the edge from " + edge.first + " to " + name + ", but " + name + " has no FK to " + edge.first);
+            }
+        }
+    }
+    for(TableId root : roots) {
+        if(skipped[root]) throw std::runtime_error("root table " + graph.tableName(root) + " is skipped in the config");
+        if(graph.primaryKey(root).size() != 1) {
+            throw std::runtime_error("root table " + graph.tableName(root) + " needs a single-column primary key to look its ids up by");
+        }
+    }
+
+    // Tables that only reference copied rows without being referenced by any
+    // can never gain a row, so they are left out.
+    std::vector<bool> direct = directDescendants(graph, roots, skipped);
+    std::vector<TableId> copied = copiedTables(graph, direct, skipped);
+    std::vector<bool> isRoot(graph.tableCount(), false);
+    for(TableId root : roots) {
+        isRoot[root] = true;
+    }
+
+    Components components = stronglyConnectedComponents(graph, copied);
+    const auto& componentOf = components.componentOf;
+    auto inGraph = [&](TableId table) { return componentOf[table] != Components::NONE; };
+    std::vector<std::vector<uint32_t>> levels = topoSort(graph, components);
+
+    // Components are kept in load order, supporters first. The walk down the
+    // direct descendants follows it, the extraction of the final key sets runs
+    // against it. A cycle is either all direct descendants or none: its
+    // members reach each other along dependent edges.
+    Plan plan;
+    std::vector<size_t> componentIndex(components.members.size());
+    std::vector<uint32_t> load_order;
+    for(const auto& level : levels) {
+        load_order.insert(load_order.end(), level.begin(), level.end());
+    }
+    for(uint32_t component : load_order) {
+        componentIndex[component] = plan.components.size();
+        ComponentPlan& cp = plan.components.emplace_back();
+        cp.cyclic = components.cyclic[component];
+        for(TableId table : components.members[component]) {
+            TablePlan tp;
+            tp.table = table;
+            tp.name = graph.tableName(table);
+            tp.directDescendant = direct[table];
+            tp.root = isRoot[table];
+            tp.component = componentIndex[component];
+            for(ColumnId column : graph.primaryKey(table)) {
+                tp.primaryKey.push_back(graph.columnName(column));
+            }
+            // Rows referencing a skipped table keep the rest of their values.
+            tp.excludedColumns = ruleOf(tp.name).excludeColumns;
+            for(ConstraintId id : graph.supporterEdges(table)) {
+                if(!skipped[graph.constraint(id).foreignTable]) continue;
+                for(ColumnId column : graph.columnsOf(graph.constraint(id))) {
+                    const std::string& name = graph.columnName(column);
+                    if(std::find(tp.excludedColumns.begin(), tp.excludedColumns.end(), name) == tp.excludedColumns.end()) {
+                        tp.excludedColumns.push_back(name);
+                    }
+                }
+            }
+            for(const auto& column : tp.primaryKey) {
+                if(std::find(tp.excludedColumns.begin(), tp.excludedColumns.end(), column) != tp.excludedColumns.end()) {
+                    throw std::runtime_error("Table " + tp.name + ": primary key column " + column + " cannot be excluded");
+                }
+            }
+            cp.members.push_back(plan.tables.size());
+            plan.indexOf[tp.name] = plan.tables.size();
+            plan.tables.push_back(std::move(tp));
+        }
+    }
+
+    for(TablePlan& tp : plan.tables) {
+        const TableId table = tp.table;
+
+        // Only keys travel between steps: the primary key plus every column a
+        // join reads. Tables without a primary key carry whole rows.
+        if(tp.primaryKey.empty()) {
+            tp.keyList = quoteIdentifier(tp.name) + ".*";
+            tp.fetchQuery = "SELECT * FROM " + tempName(tp.name);
+        } else {
+            std::vector<std::string> keys = tp.primaryKey;
+            auto addKey = [&](ColumnId column) {
+                const std::string& name = graph.columnName(column);
+                if(std::find(keys.begin(), keys.end(), name) == keys.end()) keys.push_back(name);
+            };
+            for(ConstraintId id : graph.supporterEdges(table)) {
+                if(!inGraph(graph.constraint(id).foreignTable)) continue;
+                for(ColumnId column : graph.columnsOf(graph.constraint(id))) addKey(column);
+            }
+            for(ConstraintId id : graph.dependentEdges(table)) {
+                if(!inGraph(graph.constraint(id).table)) continue;
+                for(ColumnId column : graph.foreignColumnsOf(graph.constraint(id))) addKey(column);
+            }
+            for(size_t i = 0; i < keys.size(); ++i) {
+                if(i != 0) tp.keyList += ", ";
+                tp.keyList += qualified(tp.name, keys[i]);
+            }
+
+            std::string pkQualified, pkBare;
+            for(size_t i = 0; i < tp.primaryKey.size(); ++i) {
+                if(i != 0) { pkQualified += ", "; pkBare += ", "; }
+                pkQualified += qualified(tp.name, tp.primaryKey[i]);
+                pkBare += quoteIdentifier(tp.primaryKey[i]);
+            }
+            tp.fetchQuery = "SELECT " + quoteIdentifier(tp.name) + ".* FROM " + quoteIdentifier(tp.name)
+                + " WHERE (" + pkQualified + ") IN (SELECT " + pkBare + " FROM " + tempName(tp.name) + ")";
+        }
+    }
+
+    // Going down, a direct descendant's rows come from the DOWN_ key tables of
+    // the direct descendants it references. Going up, every table's final rows
+    // come from the TEMP_ key tables of the tables referencing it, so whatever
+    // a copied row references is copied too. Seeds only read key tables of
+    // other components; edges inside a cycle are followed by the component's
+    // closures once all its seeds exist.
+    // Per direct descendant, the condition every row it gains going down
+    // meets: it references rows every direct descendant outside its component
+    // gained, and passes its predicate. Caps narrow the rows beyond that per edge.
+    std::vector<std::string> descentFilter(plan.tables.size());
+    for(TablePlan& tp : plan.tables) {
+        const TableId table = tp.table;
+        auto outside = [&](TableId neighbour) { return inGraph(neighbour) && componentOf[neighbour] != componentOf[table]; };
+        const std::string select = "SELECT " + std::string(tp.primaryKey.empty() ? "DISTINCT " : "") + tp.keyList + " FROM " + quoteIdentifier(tp.name);
+        if(tp.directDescendant) {
+            // A row qualifies when it references a row that every direct
+            // descendant it references gained going down. Caps come last, each
+            // ranking the rows that pass everything before it.
+            const TableConfig& rule = ruleOf(tp.name);
+            std::vector<std::string> conditions;
+            std::vector<std::tuple<std::vector<ConstraintId>, std::string, const EdgeConfig*>> caps;
+            for(const auto& [supporter, constraints] : groupByNeighbour(graph, graph.supporterEdges(table), true, outside)) {
+                if(!direct[supporter]) continue;
+                std::vector<std::string> matches;
+                for(ConstraintId id : constraints) matches.push_back(matchConstraint(graph, graph.constraint(id), "DOWN_"));
+                std::string condition = existsIn(downName(graph.tableName(supporter)), matches);
+                auto edge = rule.edges.find(graph.tableName(supporter));
+                if(edge == rule.edges.end()) {
+                    conditions.push_back(condition);
+                } else {
+                    caps.emplace_back(constraints, condition, &edge->second);
+                }
+                tp.descentInputs.push_back(plan.indexOf.at(graph.tableName(supporter)));
+            }
+            bool reached = !conditions.empty() || !caps.empty();
+            if(!rule.where.empty()) conditions.push_back("(" + rule.where + ")");
+            std::string filter;
+            for(const auto& condition : conditions) filter += (filter.empty() ? "" : " AND ") + condition;
+            std::string& uncapped = descentFilter[plan.indexOf.at(tp.name)];
+            uncapped = filter;
+            for(const auto& [constraints, condition, edge] : caps) {
+                uncapped += (uncapped.empty() ? "" : " AND ") + condition;
+                filter = capEdge(graph, tp, constraints, condition, *edge, filter);
+            }
+            // A cycle member only reached through the cycle starts out empty.
+            if(reached) {
+                tp.descentJoin = select + " WHERE " + filter;
+            } else if(!tp.root) {
+                tp.descentJoin = select + " WHERE false";
+            }
+        }
+
+        // A row is copied when a copied row of any dependent references it, and
+        // a direct descendant keeps every row it gained going down. Only a
+        // cycle member reached through the cycle alone starts out empty.
+        std::vector<std::string> conditions;
+        for(const auto& [dependent, constraints] : groupByNeighbour(graph, graph.dependentEdges(table), false, outside)) {
+            std::vector<std::string> matches;
+            for(ConstraintId id : constraints) matches.push_back(matchConstraintFromDependent(graph, graph.constraint(id), "TEMP_"));
+            conditions.push_back(existsIn(tempName(graph.tableName(dependent)), matches));
+            tp.inputs.push_back(plan.indexOf.at(graph.tableName(dependent)));
+        }
+        if(!tp.directDescendant) {
+            tp.joinQuery = select + whereClause(conditions, "OR");
+        } else if(conditions.empty()) {
+            tp.joinQuery = "SELECT * FROM " + downName(tp.name);
+        } else {
+            tp.joinQuery = "SELECT * FROM " + downName(tp.name) + " UNION " + select + whereClause(conditions, "OR");
+        }
+    }
+
+    // Levels group steps whose inputs all come from earlier levels, so the
+    // steps of a level can run at the same time and still see exactly what a
+    // serial run would. Going down, supporters come first; the final key sets
+    // are extracted dependents first, each after its own walk down.
+    auto addStep = [&](size_t level, ExtractStep step) {
+        if(plan.extractLevels.size() <= level) plan.extractLevels.resize(level + 1);
+        plan.extractLevels[level].push_back(step);
+    };
+    for(size_t index = 0; index < plan.components.size(); ++index) {
+        ComponentPlan& cp = plan.components[index];
+        if(!plan.tables[cp.members[0]].directDescendant) continue;
+        for(size_t member : cp.members) {
+            for(size_t input : plan.tables[member].descentInputs) {
+                cp.descentInputs.push_back(input);
+                cp.descentLevel = std::max(cp.descentLevel, plan.components[plan.tables[input].component].descentLevel + 1);
+            }
+        }
+        addStep(cp.descentLevel, { index, true });
+    }
+    for(size_t index = plan.components.size(); index-- > 0;) {
+        ComponentPlan& cp = plan.components[index];
+        if(plan.tables[cp.members[0]].directDescendant) cp.extractLevel = cp.descentLevel + 1;
+        for(size_t member : cp.members) {
+            for(size_t input : plan.tables[member].inputs) {
+                cp.inputs.push_back(input);
+                cp.extractLevel = std::max(cp.extractLevel, plan.components[plan.tables[input].component].extractLevel + 1);
+            }
+        }
+        addStep(cp.extractLevel, { index, false });
+    }
+
+    for(size_t index = 0; index < plan.components.size(); ++index) {
+        ComponentPlan& cp = plan.components[index];
+
+        for(size_t member : cp.members) {
+            for(ConstraintId id : graph.supporterEdges(plan.tables[member].table)) {
+                TableId supporter = graph.constraint(id).foreignTable;
+                if(!inGraph(supporter)) continue;
+                size_t component = componentIndex[componentOf[supporter]];
+                if(component != index && std::find(cp.supporters.begin(), cp.supporters.end(), component) == cp.supporters.end()) {
+                    cp.supporters.push_back(component);
+                }
+            }
+        }
+
+        if(!cp.cyclic) continue;
+
+        std::vector<TableId> members;
+        std::vector<std::string> keyLists;
+        for(size_t member : cp.members) {
+            members.push_back(plan.tables[member].table);
+            keyLists.push_back(plan.tables[member].keyList);
+        }
+        // Direct descendants take every row hanging off their seeds going
+        // down, the same way the acyclic walk does: rows gained meet the
+        // seed's supporters and predicate, and caps on edges inside the cycle
+        // rank the rows that do. Every cycle then pulls in the rows its final key sets
+        // reference. Supporters outside the cycle are extracted after it, so
+        // they take those rows in as well.
+        if(plan.tables[cp.members[0]].directDescendant) {
+            Narrow narrow = [&](size_t m, TableId neighbour, const std::vector<ConstraintId>& constraints, const std::string& condition) {
+                const TablePlan& tp = plan.tables[cp.members[m]];
+                const std::string& filter = descentFilter[cp.members[m]];
+                const TableConfig& rule = ruleOf(tp.name);
+                auto edge = rule.edges.find(graph.tableName(neighbour));
+                if(edge != rule.edges.end()) return capEdge(graph, tp, constraints, condition, edge->second, filter);
+                return filter.empty() ? condition : "(" + condition + " AND " + filter + ")";
+            };
+            cp.descentClosure = fixpoint(graph, members, keyLists, "DOWN_", true, narrow);
+        }
+        cp.closure = fixpoint(graph, members, keyLists, "TEMP_", false);
+
+        // Members load in this order inside one transaction with constraints
+        // deferred. A non-deferrable FK to a member loaded later cannot wait,
+        // so its columns go in as NULL and are patched afterwards. References
+        // to the same table need neither: RI is checked at the end of the COPY.
+        for(size_t m = 0; m < cp.members.size(); ++m) {
+            TablePlan& tp = plan.tables[cp.members[m]];
+            for(ConstraintId id : graph.supporterEdges(tp.table)) {
+                const Constraint& c = graph.constraint(id);
+                if(c.deferrable || std::find(members.begin() + m + 1, members.end(), c.foreignTable) == members.end()) continue;
+                for(ColumnId column : graph.columnsOf(c)) {
+                    const std::string& name = graph.columnName(column);
+                    if(std::find(tp.patchColumns.begin(), tp.patchColumns.end(), name) == tp.patchColumns.end()) {
+                        tp.patchColumns.push_back(name);
+                    }
+                }
+            }
+            if(!tp.patchColumns.empty() && tp.primaryKey.empty()) {
+                throw std::runtime_error("Table " + tp.name + " is in an FK cycle through a non-deferrable constraint but has no primary key to patch it by");
+            }
+        }
+    }
+
+    // Predicates and caps only act going down, along edges between direct
+    // descendants. Rules for tables these roots never reach stay quiet: the
+    // same config serves other roots.
+    for(const auto& [name, rule] : rules) {
+        auto index = plan.indexOf.find(name);
+        if(index == plan.indexOf.end()) continue;
+        const TablePlan& tp = plan.tables[index->second];
+        if(!rule.where.empty() && !tp.directDescendant) {
+            plan.warnings.push_back("where of " + name + " is not applied: " + name + " gains no rows going down from these roots");
+        }
+        for(const auto& edge : rule.edges) {
+            if(!tp.directDescendant || !direct[*graph.findTable(edge.first)]) {
+                plan.warnings.push_back("cap on the edge from " + edge.first + " to " + name + " is not applied: the walk down from these roots does not follow it");
+            }
+        }
+    }
+
+    for(const auto& level : levels) {
+        std::vector<size_t>& loadLevel = plan.loadLevels.emplace_back();
+        for(uint32_t component : level) {
+            loadLevel.push_back(componentIndex[component]);
+        }
+    }
+    return plan;
+}
+
+std::string descentQuery(const TablePlan& table, const RootIdsOf& rootIdsOf) {
+    if(!table.root) return table.descentJoin;
+    std::string rootQuery = "SELECT " + table.keyList + " FROM " + quoteIdentifier(table.name)
+        + " WHERE " + quoteIdentifier(table.name) + "." + quoteIdentifier(table.primaryKey[0]) + " = ANY(" + quoteArrayLiteral(rootIdsOf(table)) + ")";
+    return table.descentJoin.empty() ? rootQuery : table.descentJoin + " UNION " + rootQuery;
+}
+
+void describeColumns(Plan& plan, PgConnection& conn) {
+    std::vector<std::string> names;
+    for(const auto& table : plan.tables) names.push_back(table.name);
+    if(names.empty()) return;
+
+    std::unordered_map<std::string, std::vector<std::string>> found;
+    for(const auto& row : conn.query(
+        "SELECT c.relname, a.attname, a.attnotnull AND NOT a.atthasdef, format_type(a.atttypid, a.atttypmod), a.attnotnull "
+        "FROM pg_attribute a "
+        "JOIN pg_class c ON c.oid = a.attrelid "
+        "JOIN pg_namespace n ON n.oid = c.relnamespace "
+        "WHERE n.nspname = 'public' AND c.relname = ANY(" + quoteArrayLiteral(names) + "::text[]) AND a.attnum > 0 AND NOT a.attisdropped "
+        "ORDER BY c.relname, a.attnum;")) {
+        TablePlan& table = plan.tables[plan.indexOf.at(row.at(0))];
+        const std::string& column = row.at(1);
+        bool patched = std::find(table.patchColumns.begin(), table.patchColumns.end(), column) != table.patchColumns.end();
+        if(patched && row.at(4) == "t") {
+            throw std::runtime_error("column " + table.name + "." + column + " closes an FK cycle through a non-deferrable constraint but is NOT NULL, so it cannot be loaded as NULL and patched");
+        }
+        if(std::find(table.excludedColumns.begin(), table.excludedColumns.end(), column) == table.excludedColumns.end()) {
+            table.columns.push_back({ column, row.at(3) });
+        } else if(row.at(2) == "t") {
+            throw std::runtime_error("column " + table.name + "." + column + " is NOT NULL without a default and cannot be excluded");
+        } else {
+            found[table.name].push_back(column);
+        }
+    }
+
+    for(TablePlan& table : plan.tables) {
+        if(table.excludedColumns.empty()) continue;
+        for(const auto& column : table.excludedColumns) {
+            const auto& columns = found[table.name];
+            if(std::find(columns.begin(), columns.end(), column) == columns.end()) {
+                throw std::runtime_error("excluded column " + table.name + "." + column + " does not exist");
+            }
+        }
+        std::string columns;
+        for(const auto& column : table.columns) {
+            if(!columns.empty()) columns += ", ";
+            columns += quoteIdentifier(column.name);
+        }
+        // Both fetch forms read a single table, so bare names resolve.
+        table.fetchQuery = "SELECT " + columns + table.fetchQuery.substr(table.fetchQuery.find(" FROM "));
+        table.columnList = " (" + columns + ")";
+    }
+}
+
+std::string columnsFingerprint(PgConnection& conn) {
+    return conn.query(
+        "SELECT md5(coalesce(string_agg(c.relname || ':' || a.attnum || ':' || a.attname || ':' || format_type(a.atttypid, a.atttypmod) "
+        "|| ':' || a.attnotnull::text || ':' || a.atthasdef::text, ',' ORDER BY c.relname, a.attnum), '')) "
+        "FROM pg_attribute a "
+        "JOIN pg_class c ON c.oid = a.attrelid "
+        "JOIN pg_namespace n ON n.oid = c.relnamespace "
+        "WHERE n.nspname = 'public' AND c.relkind IN ('r', 'p') AND a.attnum > 0 AND NOT a.attisdropped;").at(0).at(0);
+}
@@ -0,0 +1,108 @@
+#pragma once
+
+#include <functional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "config.hpp"
+#include "graph.hpp"
+#include "pg.hpp"
+
+struct ColumnPlan {
+    std::string name;
+    std::string type;                       // format_type() text, e.g. "character varying(40)"
+};
+
+struct TablePlan {
+    TableId table;
+    std::string name;
+    bool directDescendant = false;
+    bool root = false;
+    size_t component = 0;                   // index into Plan::components
+    std::vector<size_t> descentInputs;      // tables (indexes into Plan::tables) whose DOWN_ key tables the descent reads
+    std::vector<size_t> inputs;             // tables whose TEMP_ key tables the extract query reads
+    std::vector<std::string> primaryKey;    // empty when the table has none
+    std::string keyList;                    // columns carried in DOWN_<table> and TEMP_<table>
+    // Direct descendants only: the rows that reference rows every direct
+    // descendant they reference gained going down. Empty for a root that no
+    // other table leads to.
+    std::string descentJoin;
+    // Every table: the rows the TEMP_ key tables of its dependents reference,
+    // and a direct descendant's DOWN_ rows. The rows that are copied.
+    std::string joinQuery;
+    std::string fetchQuery;                 // full rows for the keys in TEMP_<table>
+    // Columns neither fetched nor loaded: excluded in the config, or FKs into a
+    // skipped table. The load fills them with their default.
+    std::vector<std::string> excludedColumns;
+    std::string columnList;                 // " (a, b, ...)" for COPY once columns are excluded, else empty
+    std::vector<ColumnPlan> columns;        // fetched columns in COPY order, set by describeColumns
+    // Non-deferrable FK columns that point at a member of the same cycle loaded
+    // later. They are inserted as NULL and patched once that member is in.
+    std::vector<std::string> patchColumns;
+};
+
+// A strongly connected component: one table, or a set of tables tied together
+// by FK cycles (self-references included) that is extracted and loaded as a unit.
+struct ComponentPlan {
+    std::vector<size_t> members;            // indexes into Plan::tables, in load order
+    bool cyclic = false;
+    std::vector<size_t> descentInputs;      // tables outside the component the members' descents read
+    std::vector<size_t> inputs;             // tables outside the component the members' extract queries read
+    std::vector<size_t> supporters;         // components the members reference, which must load first
+    // Server-side fixpoints that grow the members' key tables from their seeds
+    // along the edges inside the component: DOWN_ going down for a cycle of
+    // direct descendants, TEMP_ going up for any cycle. Empty when acyclic.
+    std::string descentClosure;
+    std::string closure;
+    size_t descentLevel = 0;                // direct descendants only
+    size_t extractLevel = 0;
+};
+
+// A component's walk down into its DOWN_ key tables, or the extraction of its
+// TEMP_ key tables and then of its full rows.
+struct ExtractStep {
+    size_t component;
+    bool descent;
+};
+
+struct Plan {
+    std::vector<TablePlan> tables;                      // load order
+    std::vector<ComponentPlan> components;
+    std::vector<std::vector<ExtractStep>> extractLevels; // steps whose inputs are all in earlier levels
+    std::vector<std::vector<size_t>> loadLevels;    // components whose supporters are all in earlier levels
+    std::unordered_map<std::string, size_t> indexOf;
+    std::vector<std::string> warnings;                  // config rules these roots leave unused
+};
+
+// The root ids given for a root table, empty for any other table.
+using RootIdsOf = std::function<const std::vector<std::string>&(const TablePlan&)>;
+
+// "TEMP_<table>", quoted: the keys of the rows copied from table.
+std::string tempName(const std::string& table);
+
+// "DOWN_<table>", quoted: the keys of the rows a direct descendant gains going down.
+std::string downName(const std::string& table);
+
+// Plans the traversal of the roots' direct descendants and of every table
+// they reference. Skipped tables are left out along with everything only
+// reachable through them; predicates and edge caps narrow the rows reached
+// going down. Rows that copied rows reference are always taken, so the copy
+// stays loadable. Throws when a rule names a table or an edge the schema does
+// not have; rules the walk down never gets to are listed in Plan::warnings.
+Plan buildPlan(const SchemaGraph& graph, const std::vector<TableId>& roots, const TableRules& rules = {});
+
+// Reads every table's columns and types from conn, and narrows the fetch and
+// load of tables with excluded columns to the rest. Throws when an excluded
+// column is NOT NULL without a default, since the load could not fill it, and
+// when a column to patch is NOT NULL, since it could not go in as NULL first.
+void describeColumns(Plan& plan, PgConnection& conn);
+
+// Hash of every column's position, name, type and nullability in the public
+// schema, computed server side. describeColumns' result holds while it is unchanged.
+std::string columnsFingerprint(PgConnection& conn);
+
+// Query whose result seeds DOWN_<table>: the join, with a root's own rows
+// unioned in. Only these drive the walk down; the rows root rows reference are
+// taken going up, like those of any other copied row.
+std::string descentQuery(const TablePlan& table, const RootIdsOf& rootIdsOf);
@@ -0,0 +1,46 @@
+#include "pool.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <mutex>
+#include <thread>
+
+ConnectionPool::ConnectionPool(const DatabaseInfo& info, size_t size) {
+    for(size_t i = 0; i < std::max<size_t>(size, 1); ++i) {
+        connections.push_back(std::make_unique<PgConnection>(info));
+    }
+}
+
+void parallelFor(ConnectionPool& pool, size_t count, const std::function<void(size_t, PgConnection&)>& fn) {
+    size_t workers = std::min(pool.size(), count);
+    if(workers <= 1) {
+        for(size_t i = 0; i < count; ++i) fn(i, pool.at(0));
+        return;
+    }
+
+    std::atomic<size_t> next{0};
+    std::atomic<bool> failed{false};
+    std::exception_ptr error;
+    std::mutex errorMutex;
+
+    std::vector<std::thread> threads;
+    for(size_t w = 0; w < workers; ++w) {
+        threads.emplace_back([&, w]() {
+            PgConnection& conn = pool.at(w);
+            while(!failed) {
+                size_t i = next++;
+                if(i >= count) break;
+                try {
+                    fn(i, conn);
+                } catch(...) {
+                    std::lock_guard<std::mutex> lock(errorMutex);
+                    if(!error) error = std::current_exception();
+                    failed = true;
+                }
+            }
+        });
+    }
+    for(auto& thread : threads) thread.join();
+    if(error) std::rethrow_exception(error);
+}
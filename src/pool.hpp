@@ -0,0 +1,27 @@
+#pragma once
+
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <vector>
+
+#include "config.hpp"
+#include "pg.hpp"
+
+// A fixed set of connections to one database, one per worker.
+class ConnectionPool {
+public:
+    ConnectionPool(const DatabaseInfo& info, size_t size);
+
+    size_t size() const { return connections.size(); }
+    PgConnection& at(size_t i) { return *connections[i]; }
+
+private:
+    std::vector<std::unique_ptr<PgConnection>> connections;
+};
+
+// Calls fn(i, connection) for every i in [0, count), running at most
+// pool.size() calls at once. Each worker owns one pooled connection for the
+// whole call. The first exception thrown by any worker is rethrown after all
+// workers have stopped.
+void parallelFor(ConnectionPool& pool, size_t count, const std::function<void(size_t, PgConnection&)>& fn);
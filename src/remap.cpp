@@ -0,0 +1,267 @@
+#include "remap.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include <random>
+#include <stdexcept>
+#include <unordered_map>
+
+#include "pgcopy.hpp"
+
+namespace {
+
+// Field index of a binary COPY tuple; length is -1 for NULL or a missing field.
+const char* fieldAt(const char* tuple, size_t index, int32_t& length) {
+    size_t count = static_cast<size_t>(std::max<int16_t>(readInt16(tuple), 0));
+    const char* at = tuple + 2;
+    length = -1;
+    if(index >= count) return nullptr;
+    for(size_t i = 0; i < index; ++i) {
+        int32_t skip = readInt32(at);
+        at += 4 + std::max(skip, 0);
+    }
+    length = readInt32(at);
+    return at + 4;
+}
+
+// int2, int4 and int8 are sent big-endian at their own width.
+bool parseInt(const char* data, int32_t length, int64_t& value) {
+    if(length != 2 && length != 4 && length != 8) return false;
+    uint64_t bits = 0;
+    for(int32_t i = 0; i < length; ++i) bits = (bits << 8) | static_cast<unsigned char>(data[i]);
+    int shift = 64 - 8 * length;
+    value = static_cast<int64_t>(bits << shift) >> shift;
+    return true;
+}
+
+void appendInt(int64_t value, int32_t length, std::string& out) {
+    if(length < 8) {
+        int64_t max = (int64_t(1) << (8 * length - 1)) - 1;
+        if(value > max || value < -max - 1) {
+            throw std::runtime_error("remapped id " + std::to_string(value) + " does not fit its column");
+        }
+    }
+    for(int shift = 8 * (length - 1); shift >= 0; shift -= 8) {
+        out += static_cast<char>((value >> shift) & 0xFF);
+    }
+}
+
+// A uuid is its 16 bytes in order.
+bool parseUuid(const char* data, int32_t length, Uuid& value) {
+    if(length != 16) return false;
+    value = {};
+    for(int i = 0; i < 8; ++i) {
+        value.high = (value.high << 8) | static_cast<unsigned char>(data[i]);
+        value.low = (value.low << 8) | static_cast<unsigned char>(data[8 + i]);
+    }
+    return true;
+}
+
+void appendUuid(const Uuid& value, std::string& out) {
+    for(int shift = 56; shift >= 0; shift -= 8) out += static_cast<char>((value.high >> shift) & 0xFF);
+    for(int shift = 56; shift >= 0; shift -= 8) out += static_cast<char>((value.low >> shift) & 0xFF);
+}
+
+Uuid randomUuid(std::mt19937_64& rng) {
+    Uuid id{ rng(), rng() };
+    id.high = (id.high & ~0xF000ULL) | 0x4000ULL;                     // version 4
+    id.low = (id.low & 0x3FFFFFFFFFFFFFFFULL) | 0x8000000000000000ULL; // RFC 4122 variant
+    return id;
+}
+
+} // namespace
+
+Remapper::Remapper(const SchemaGraph& graph, const Plan& plan, PgConnection& destination) : tables(plan.tables.size()) {
+    // Column order, type and owning sequence of every column, in one query.
+    struct Column {
+        std::string name;
+        std::string type;
+        std::string sequence;
+    };
+    std::unordered_map<std::string, std::vector<Column>> columns;
+    for(const auto& row : destination.query(
+        "SELECT c.relname, a.attname, a.atttypid::regtype::text, "
+        "    CASE WHEN a.atttypid IN ('int2'::regtype, 'int4'::regtype, 'int8'::regtype) "
+        "        THEN pg_get_serial_sequence(format('%I', c.relname), a.attname) END "
+        "FROM pg_attribute a "
+        "JOIN pg_class c ON c.oid = a.attrelid "
+        "JOIN pg_namespace n ON n.oid = c.relnamespace "
+        "WHERE n.nspname = 'public' AND c.relkind IN ('r', 'p') AND a.attnum > 0 AND NOT a.attisdropped "
+        "ORDER BY c.relname, a.attnum;")) {
+        columns[row.at(0)].push_back({ row.at(1), row.at(2), row.at(3) });
+    }
+    // Excluded columns are not in the COPY stream, so fields follow the rest.
+    for(const TablePlan& table : plan.tables) {
+        auto& list = columns[table.name];
+        std::erase_if(list, [&](const Column& column) {
+            return std::find(table.excludedColumns.begin(), table.excludedColumns.end(), column.name) != table.excludedColumns.end();
+        });
+    }
+    auto positionOf = [&](const std::string& table, const std::string& column) -> size_t {
+        const auto& list = columns[table];
+        for(size_t i = 0; i < list.size(); ++i) {
+            if(list[i].name == column) return i;
+        }
+        throw std::runtime_error("column " + table + "." + column + " is missing in the destination");
+    };
+
+    for(size_t index = 0; index < plan.tables.size(); ++index) {
+        const TablePlan& table = plan.tables[index];
+        TableRemap& remap = tables[index];
+        remap.fieldSource.assign(columns[table.name].size(), KEEP);
+        if(table.primaryKey.size() != 1) continue;
+
+        remap.keyColumn = positionOf(table.name, table.primaryKey[0]);
+        const Column& key = columns[table.name][remap.keyColumn];
+        if(key.type == "uuid") {
+            remap.kind = KeyKind::UUID;
+        } else if(!key.sequence.empty()) {
+            remap.kind = KeyKind::INT64;
+            remap.sequence = key.sequence;
+        } else {
+            if(key.type == "smallint" || key.type == "integer" || key.type == "bigint") {
+                std::cerr << "Table " << table.name << ": key " << key.name << " has no sequence, keys are copied as-is\n";
+            }
+            continue;
+        }
+        remap.fieldSource[remap.keyColumn] = index;
+    }
+
+    // FK columns pointing at a remapped key follow that key's map.
+    for(size_t index = 0; index < plan.tables.size(); ++index) {
+        const TablePlan& table = plan.tables[index];
+        for(ConstraintId id : graph.supporterEdges(table.table)) {
+            const Constraint& c = graph.constraint(id);
+            auto supporter = plan.indexOf.find(graph.tableName(c.foreignTable));
+            if(supporter == plan.indexOf.end() || tables[supporter->second].kind == KeyKind::NONE) continue;
+            const TablePlan& supporterPlan = plan.tables[supporter->second];
+            auto localColumns = graph.columnsOf(c);
+            auto foreignColumns = graph.foreignColumnsOf(c);
+            // An FK with an excluded column is not copied, so there is nothing to rewrite.
+            bool excluded = std::any_of(localColumns.begin(), localColumns.end(), [&](ColumnId column) {
+                const std::string& name = graph.columnName(column);
+                return std::find(table.excludedColumns.begin(), table.excludedColumns.end(), name) != table.excludedColumns.end();
+            });
+            if(excluded) continue;
+            for(size_t i = 0; i < localColumns.size(); ++i) {
+                if(graph.columnName(foreignColumns[i]) != supporterPlan.primaryKey[0]) continue;
+                tables[index].fieldSource[positionOf(table.name, graph.columnName(localColumns[i]))] = supporter->second;
+            }
+        }
+    }
+}
+
+void Remapper::assignKeys(size_t table, const RowSet& rows, PgConnection& destination) {
+    TableRemap& remap = tables[table];
+    if(remap.kind == KeyKind::NONE) return;
+
+    size_t count = 0;
+    forEachTuple(rows, [&](const char*, size_t) { count++; });
+
+    if(remap.kind == KeyKind::INT64) {
+        remap.intIds.reserve(count);
+        // New ids come from the destination's own sequence, a block per round
+        // trip, so concurrent writers to the destination never collide with them.
+        std::vector<int64_t> block;
+        size_t next = 0, assigned = 0;
+        forEachTuple(rows, [&](const char* tuple, size_t) {
+            int32_t length;
+            const char* field = fieldAt(tuple, remap.keyColumn, length);
+            int64_t old_id;
+            if(!parseInt(field, length, old_id)) return;
+            if(next == block.size()) {
+                size_t size = std::min(ID_BLOCK, count - assigned);
+                block.clear();
+                next = 0;
+                for(const auto& row : destination.query("SELECT nextval(" + quoteLiteral(remap.sequence) + ") FROM generate_series(1, " + std::to_string(size) + ");")) {
+                    block.push_back(std::stoll(row.at(0)));
+                }
+            }
+            remap.intIds.insert(old_id, block[next++]);
+            assigned++;
+        });
+    } else {
+        remap.uuidIds.reserve(count);
+        std::mt19937_64 rng{ std::random_device{}() ^ (static_cast<uint64_t>(std::random_device{}()) << 32) };
+        forEachTuple(rows, [&](const char* tuple, size_t) {
+            int32_t length;
+            const char* field = fieldAt(tuple, remap.keyColumn, length);
+            Uuid old_id;
+            if(!parseUuid(field, length, old_id)) return;
+            remap.uuidIds.insert(old_id, randomUuid(rng));
+        });
+    }
+}
+
+void Remapper::rewriteField(size_t source, const char* data, int32_t length, std::string& out) const {
+    // New values keep the old width, so the length prefix stays as it was.
+    appendInt32(out, length);
+    if(length < 0) return;
+    const TableRemap& remap = tables[source];
+    if(remap.kind == KeyKind::INT64) {
+        int64_t id;
+        const int64_t* mapped = parseInt(data, length, id) ? remap.intIds.find(id) : nullptr;
+        if(mapped) {
+            appendInt(*mapped, length, out);
+            return;
+        }
+    } else {
+        Uuid id;
+        const Uuid* mapped = parseUuid(data, length, id) ? remap.uuidIds.find(id) : nullptr;
+        if(mapped) {
+            appendUuid(*mapped, out);
+            return;
+        }
+    }
+    out.append(data, length);
+}
+
+size_t Remapper::copyIn(PgConnection& conn, const std::string& copyInSql, size_t table, const RowSet& rows) const {
+    const TableRemap& remap = tables[table];
+    bool rewrites = false;
+    for(size_t source : remap.fieldSource) {
+        if(source != KEEP) rewrites = true;
+    }
+    if(!rewrites) return copyInFromRowSet(conn, copyInSql, rows);
+
+    // Rows are rewritten into one block-sized buffer at a time and sent as it
+    // fills, so memory stays flat however large the table is.
+    size_t bytes = 0;
+    std::string out = copyHeader("");
+    out.reserve(RowSet::BLOCK_SIZE + RowSet::BLOCK_SIZE / 8);
+    conn.beginCopyIn(copyInSql);
+    try {
+        forEachTuple(rows, [&](const char* tuple, size_t) {
+            int16_t count = readInt16(tuple);
+            out.append(tuple, 2);
+            const char* at = tuple + 2;
+            for(int16_t column = 0; column < count; ++column) {
+                int32_t length = readInt32(at);
+                const char* field = at + 4;
+                at = field + std::max(length, 0);
+                size_t source = static_cast<size_t>(column) < remap.fieldSource.size() ? remap.fieldSource[column] : KEEP;
+                if(source == KEEP) {
+                    out.append(field - 4, at);
+                } else {
+                    rewriteField(source, field, length, out);
+                }
+            }
+            if(out.size() >= RowSet::BLOCK_SIZE) {
+                conn.putCopyData(out.data(), out.size());
+                bytes += out.size();
+                out.clear();
+            }
+        });
+        appendInt16(out, -1);
+        if(!out.empty()) {
+            conn.putCopyData(out.data(), out.size());
+            bytes += out.size();
+        }
+    } catch(const std::exception& e) {
+        conn.abortCopyIn(e.what());
+        throw;
+    }
+    conn.endCopyIn();
+    return bytes;
+}
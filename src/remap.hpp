@@ -0,0 +1,129 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "graph.hpp"
+#include "pg.hpp"
+#include "plan.hpp"
+#include "rowset.hpp"
+
+struct Uuid {
+    uint64_t high = 0;
+    uint64_t low = 0;
+
+    bool operator==(const Uuid& other) const { return high == other.high && low == other.low; }
+};
+
+inline uint64_t mixBits(uint64_t x) {
+    // splitmix64 finalizer: sequential ids spread over the whole table.
+    x ^= x >> 30;
+    x *= 0xbf58476d1ce4e5b9ULL;
+    x ^= x >> 27;
+    x *= 0x94d049bb133111ebULL;
+    return x ^ (x >> 31);
+}
+
+inline uint64_t idHash(int64_t id) { return mixBits(static_cast<uint64_t>(id)); }
+inline uint64_t idHash(const Uuid& id) { return mixBits(id.high ^ mixBits(id.low)); }
+
+// Old key -> new key. Open addressing with linear probing over flat arrays, so
+// a lookup is a hash and usually one cache line. Only ever grows; built once
+// per table and read concurrently afterwards.
+template <typename Key>
+class IdMap {
+public:
+    void reserve(size_t count) {
+        size_t capacity = 16;
+        while(capacity * MAX_LOAD_PERCENT / 100 < count) capacity *= 2;
+        if(capacity > keys.size()) rehash(capacity);
+    }
+
+    void insert(const Key& key, const Key& value) {
+        if((count + 1) * 100 > keys.size() * MAX_LOAD_PERCENT) rehash(std::max<size_t>(16, keys.size() * 2));
+        size_t slot = idHash(key) & (keys.size() - 1);
+        while(used[slot] && !(keys[slot] == key)) slot = (slot + 1) & (keys.size() - 1);
+        if(!used[slot]) {
+            used[slot] = true;
+            keys[slot] = key;
+            count++;
+        }
+        values[slot] = value;
+    }
+
+    const Key* find(const Key& key) const {
+        if(keys.empty()) return nullptr;
+        size_t slot = idHash(key) & (keys.size() - 1);
+        while(used[slot]) {
+            if(keys[slot] == key) return &values[slot];
+            slot = (slot + 1) & (keys.size() - 1);
+        }
+        return nullptr;
+    }
+
+    size_t size() const { return count; }
+
+private:
+    static constexpr size_t MAX_LOAD_PERCENT = 70;
+
+    std::vector<Key> keys, values;
+    std::vector<uint8_t> used;
+    size_t count = 0;
+
+    void rehash(size_t capacity) {
+        std::vector<Key> oldKeys = std::move(keys), oldValues = std::move(values);
+        std::vector<uint8_t> oldUsed = std::move(used);
+        keys.assign(capacity, Key{});
+        values.assign(capacity, Key{});
+        used.assign(capacity, 0);
+        count = 0;
+        for(size_t i = 0; i < oldKeys.size(); ++i) {
+            if(oldUsed[i]) insert(oldKeys[i], oldValues[i]);
+        }
+    }
+};
+
+// Gives copied rows new primary keys in the destination and rewrites every FK
+// column that points at a remapped key, while the binary COPY streams in.
+// Integer keys come from the column's sequence in blocks; uuid keys are
+// generated. Tables with composite or other keys keep theirs, though their FK
+// columns are still rewritten.
+class Remapper {
+public:
+    // Reads column order, key types and sequences from the destination.
+    Remapper(const SchemaGraph& graph, const Plan& plan, PgConnection& destination);
+
+    // Assigns a new key to every row of one table. Tables are independent, so
+    // this may run for several tables at once. A table's copyIn needs the keys
+    // of every table it references: its supporters and the rest of its cycle.
+    void assignKeys(size_t table, const RowSet& rows, PgConnection& destination);
+
+    // copyInFromRowSet with every remapped column rewritten on the way.
+    size_t copyIn(PgConnection& conn, const std::string& copyInSql, size_t table, const RowSet& rows) const;
+
+private:
+    enum class KeyKind { NONE, INT64, UUID };
+
+    static constexpr size_t ID_BLOCK = 8192;
+    static constexpr size_t KEEP = SIZE_MAX;
+
+    struct TableRemap {
+        KeyKind kind = KeyKind::NONE;
+        size_t keyColumn = 0;
+        std::string sequence;
+        // Per COPY field: the plan index of the table whose key map rewrites
+        // it (this table for its own key, the supporter for an FK), or KEEP.
+        std::vector<size_t> fieldSource;
+        IdMap<int64_t> intIds;
+        IdMap<Uuid> uuidIds;
+    };
+
+    std::vector<TableRemap> tables;
+
+    // Appends the field, length prefix included, rewritten through source's
+    // key map. NULLs and keys outside the copy are appended unchanged.
+    void rewriteField(size_t source, const char* data, int32_t length, std::string& out) const;
+};
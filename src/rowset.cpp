@@ -0,0 +1,219 @@
+#include "rowset.hpp"
+
+#include <algorithm>
+#include <filesystem>
+#include <stdexcept>
+
+#include <zlib.h>
+
+namespace {
+
+// Inflates one gzip member of known uncompressed size into out.
+void inflateMember(const char* data, size_t size, std::string& out, size_t rawSize) {
+    out.resize(rawSize);
+    z_stream stream{};
+    if(inflateInit2(&stream, 15 + 16) != Z_OK) throw std::runtime_error("inflateInit2 failed");
+    stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data));
+    stream.avail_in = static_cast<uInt>(size);
+    stream.next_out = reinterpret_cast<Bytef*>(out.data());
+    stream.avail_out = static_cast<uInt>(rawSize);
+    int result = inflate(&stream, Z_FINISH);
+    inflateEnd(&stream);
+    if(result != Z_STREAM_END || stream.total_out != rawSize) {
+        throw std::runtime_error("corrupt compressed spill block");
+    }
+}
+
+// Deflates data as one gzip member. Spill blocks are at most a few MB, well
+// within a single deflate call.
+void deflateMember(std::string& out, const char* data, size_t size) {
+    z_stream stream{};
+    if(deflateInit2(&stream, Z_BEST_SPEED, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+        throw std::runtime_error("deflateInit2 failed");
+    }
+    size_t start = out.size();
+    out.resize(start + deflateBound(&stream, static_cast<uLong>(size)) + 32);
+    stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data));
+    stream.avail_in = static_cast<uInt>(size);
+    stream.next_out = reinterpret_cast<Bytef*>(out.data() + start);
+    stream.avail_out = static_cast<uInt>(out.size() - start);
+    int result = deflate(&stream, Z_FINISH);
+    deflateEnd(&stream);
+    if(result != Z_STREAM_END) throw std::runtime_error("deflate failed");
+    out.resize(start + stream.total_out);
+}
+
+} // namespace
+
+bool MemoryBudget::acquire(size_t bytes) {
+    std::unique_lock<std::mutex> lock(mutex);
+    while(used + bytes > limit && used > 0) {
+        if(!drainable || !drainable()) return false;
+        changed.wait(lock);
+    }
+    used += bytes;
+    return true;
+}
+
+void MemoryBudget::release(size_t bytes) {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        used -= std::min(used, bytes);
+    }
+    changed.notify_all();
+}
+
+void MemoryBudget::setDrainable(std::function<bool()> fn) {
+    std::lock_guard<std::mutex> lock(mutex);
+    drainable = std::move(fn);
+}
+
+void MemoryBudget::wake() {
+    // Taking the lock orders this after a waiter's drainable() check.
+    { std::lock_guard<std::mutex> lock(mutex); }
+    changed.notify_all();
+}
+
+RowSet& RowSet::operator=(RowSet&& other) noexcept {
+    if(this == &other) return *this;
+    clear();
+    data = std::move(other.data);
+    totalBytes = other.totalBytes;
+    budgeted = other.budgeted;
+    budget = other.budget;
+    spillPath = std::move(other.spillPath);
+    compress = other.compress;
+    spill = std::move(other.spill);
+    other.data.clear();
+    other.totalBytes = 0;
+    other.budgeted = 0;
+    other.budget = nullptr;
+    return *this;
+}
+
+void RowSet::setBudget(MemoryBudget* memoryBudget, std::string path, bool compressSpill) {
+    budget = memoryBudget;
+    spillPath = std::move(path);
+    compress = compressSpill;
+}
+
+void RowSet::append(const char* chunk, size_t size) {
+    totalBytes += size;
+    if(spill) {
+        if(spill->pending.size() + size > BLOCK_SIZE && !spill->pending.empty()) {
+            writeBlock(spill->pending.data(), spill->pending.size());
+            spill->pending.clear();
+        }
+        spill->pending.append(chunk, size);
+        return;
+    }
+    if(data.empty() || data.back().size() + size > data.back().capacity()) {
+        // Blocks start small and double up to BLOCK_SIZE, so a table of a few
+        // rows holds and is charged for a few KB rather than a full block.
+        size_t next = data.empty() ? FIRST_BLOCK_SIZE : std::min(BLOCK_SIZE, data.back().capacity() * 2);
+        size_t capacity = std::max(next, size);
+        if(budget) {
+            if(!budget->acquire(capacity)) {
+                spillToDisk();
+                spill->pending.append(chunk, size);
+                return;
+            }
+            budgeted += capacity;
+        }
+        data.emplace_back();
+        data.back().reserve(capacity);
+    }
+    data.back().append(chunk, size);
+}
+
+void RowSet::spillToDisk() {
+    spill = std::make_unique<Spill>();
+    spill->path = spillPath;
+    std::filesystem::create_directories(std::filesystem::path(spillPath).parent_path());
+    spill->out.open(spillPath, std::ios::binary | std::ios::trunc);
+    if(!spill->out.good()) {
+        throw std::runtime_error("cannot open spill file " + spillPath);
+    }
+    spill->pending.reserve(BLOCK_SIZE);
+    for(const auto& block : data) {
+        writeBlock(block.data(), block.size());
+    }
+    data.clear();
+    data.shrink_to_fit();
+    if(budget) budget->release(budgeted);
+    budgeted = 0;
+}
+
+void RowSet::writeBlock(const char* block, size_t size) {
+    size_t stored = size;
+    if(compress) {
+        std::string member;
+        deflateMember(member, block, size);
+        spill->out.write(member.data(), member.size());
+        stored = member.size();
+    } else {
+        spill->out.write(block, size);
+    }
+    if(!spill->out.good()) {
+        throw std::runtime_error("cannot write spill file " + spill->path);
+    }
+    spill->blockSizes.push_back(stored);
+    spill->rawSizes.push_back(size);
+}
+
+void RowSet::forEachBlock(const std::function<void(const char*, size_t)>& fn) const {
+    if(!spill) {
+        for(const auto& block : data) fn(block.data(), block.size());
+        return;
+    }
+    spill->out.flush();
+    std::ifstream in(spill->path, std::ios::binary);
+    std::string stored, block;
+    for(size_t i = 0; i < spill->blockSizes.size(); ++i) {
+        stored.resize(spill->blockSizes[i]);
+        if(!in.read(stored.data(), stored.size())) {
+            throw std::runtime_error("cannot read spill file " + spill->path);
+        }
+        if(compress) {
+            inflateMember(stored.data(), stored.size(), block, spill->rawSizes[i]);
+            fn(block.data(), block.size());
+        } else {
+            fn(stored.data(), stored.size());
+        }
+    }
+    if(!spill->pending.empty()) fn(spill->pending.data(), spill->pending.size());
+}
+
+void RowSet::clear() {
+    data.clear();
+    data.shrink_to_fit();
+    totalBytes = 0;
+    if(budget && budgeted > 0) budget->release(budgeted);
+    budgeted = 0;
+    if(spill) {
+        spill->out.close();
+        std::error_code ignored;
+        std::filesystem::remove(spill->path, ignored);
+        spill.reset();
+    }
+}
+
+size_t copyOutToRowSet(PgConnection& conn, const std::string& copyOutSql, RowSet& rows) {
+    return conn.copyOut(copyOutSql, [&](const char* data, size_t size) {
+        rows.append(data, size);
+    });
+}
+
+size_t copyInFromRowSet(PgConnection& conn, const std::string& copyInSql, const RowSet& rows) {
+    conn.beginCopyIn(copyInSql);
+    try {
+        rows.forEachBlock([&](const char* block, size_t size) {
+            conn.putCopyData(block, size);
+        });
+    } catch(const std::exception& e) {
+        conn.abortCopyIn(e.what());
+        throw;
+    }
+    conn.endCopyIn();
+    return rows.bytes();
+}
@@ -0,0 +1,91 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <fstream>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "pg.hpp"
+
+// Caps the bytes row sets keep in memory. A row set over the cap either waits
+// for memory (backpressure) while something will give some back, or spills.
+class MemoryBudget {
+public:
+    explicit MemoryBudget(size_t limit) : limit(limit) {}
+
+    // Takes bytes from the budget. While it is exhausted, waits as long as
+    // drainable() says a holder is on its way to releasing memory. Returns
+    // false, taking nothing, when nothing will; the caller spills instead.
+    bool acquire(size_t bytes);
+    void release(size_t bytes);
+
+    void setDrainable(std::function<bool()> fn);
+    // Re-checks waiters after drainable()'s answer may have changed.
+    void wake();
+
+private:
+    size_t limit;
+    size_t used = 0;
+    std::function<bool()> drainable;
+    std::mutex mutex;
+    std::condition_variable changed;
+};
+
+// COPY data for one table, held in blocks rather than one string per row.
+// Blocks grow from FIRST_BLOCK_SIZE to BLOCK_SIZE. Chunks are stored whole, so
+// a block never splits a row. With a budget the data moves to a spill file
+// once memory runs out.
+class RowSet {
+public:
+    static constexpr size_t FIRST_BLOCK_SIZE = 8 << 10;
+    static constexpr size_t BLOCK_SIZE = 1 << 20;
+
+    RowSet() = default;
+    RowSet(RowSet&& other) noexcept { *this = std::move(other); }
+    RowSet& operator=(RowSet&& other) noexcept;
+    ~RowSet() { clear(); }
+
+    // Counts this set's memory against budget; past it, rows go to spillPath,
+    // each block as its own gzip member when compress is set.
+    void setBudget(MemoryBudget* budget, std::string spillPath, bool compress = false);
+
+    void append(const char* data, size_t size);
+    size_t bytes() const { return totalBytes; }
+    bool spilled() const { return spill != nullptr; }
+
+    // Calls fn for every block in order, reading spilled blocks back from disk.
+    void forEachBlock(const std::function<void(const char*, size_t)>& fn) const;
+
+    // Drops the rows, returning their memory and removing any spill file.
+    void clear();
+
+private:
+    struct Spill {
+        std::string path;
+        std::ofstream out;
+        std::string pending;                // fills up to a block before it is written
+        std::vector<size_t> blockSizes;     // on disk, in order
+        std::vector<size_t> rawSizes;       // the same blocks uncompressed
+    };
+
+    std::vector<std::string> data;
+    size_t totalBytes = 0;
+    size_t budgeted = 0;
+    MemoryBudget* budget = nullptr;
+    std::string spillPath;
+    bool compress = false;
+    std::unique_ptr<Spill> spill;
+
+    void spillToDisk();
+    void writeBlock(const char* block, size_t size);
+};
+
+// Fills rows from a COPY ... TO STDOUT. Returns the number of bytes received.
+size_t copyOutToRowSet(PgConnection& conn, const std::string& copyOutSql, RowSet& rows);
+
+// Feeds rows to a COPY ... FROM STDIN. Returns the number of bytes sent.
+size_t copyInFromRowSet(PgConnection& conn, const std::string& copyInSql, const RowSet& rows);